@@ -0,0 +1,51 @@
+#include "LatticeSphereSampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+
+void LatticeSphereSampling::sample(double sphere_radius, double poisson_radius, unsigned int seed, double jitter)
+{
+	// a Poisson disk sampling of radius r covers the sphere with one sample per 1.375 r^2 on average (empirical), use the same density
+	const double area = 4.0 * PI * sphere_radius * sphere_radius;
+	const int N = std::max(8, (int)std::round(area / (1.375 * poisson_radius * poisson_radius)));
+	const double spacing = std::sqrt(area / (N * 0.5 * std::sqrt(3.0)));// edge length of an hexagonal lattice of the same density
+	const double golden_angle = PI * (3.0 - std::sqrt(5.0));
+
+	m_samples.clear();
+	m_samples.reserve(N + 6);
+
+	// start with the 6 initial octahedron vertices
+	const math::dvec3 octahedron[6] = {
+		math::dvec3(0.0, 0.0, 1.0), math::dvec3(0.0, 0.0, -1.0), math::dvec3(-1.0, 0.0, 0.0),
+		math::dvec3(0.0, -1.0, 0.0), math::dvec3(1.0, 0.0, 0.0), math::dvec3(0.0, 1.0, 0.0)
+	};
+	for (int k = 0; k < 6; ++k)
+		m_samples.push_back(octahedron[k] * sphere_radius);
+
+	// jittered spherical Fibonacci lattice
+	std::mt19937 prng(seed);
+	const double min_distance_to_octahedron = 0.5 * spacing / sphere_radius;
+	for (int i = 0; i < N; ++i)
+	{
+		const double z = 1.0 - (2.0 * i + 1.0) / N;
+		const double rho = std::sqrt(std::max(0.0, 1.0 - z * z));
+		const double phi = golden_angle * i;
+		math::dvec3 p(rho * std::cos(phi), rho * std::sin(phi), z);
+
+		const tool::MonoVectorFrame tangentFrame(p);
+		const double jx = -1.0 + 2.0 * (double)(prng() % 65536) / 65535.0;
+		const double jy = -1.0 + 2.0 * (double)(prng() % 65536) / 65535.0;
+		p = math::normalize(p + (jitter * spacing / sphere_radius) * (jx * tangentFrame.t + jy * tangentFrame.b));
+
+		bool near_octahedron = false;
+		for (int k = 0; k < 6 && !near_octahedron; ++k)
+			near_octahedron = math::distance(p, octahedron[k]) < min_distance_to_octahedron;
+		if (!near_octahedron)
+			m_samples.push_back(p * sphere_radius);
+	}
+
+	std::cout << "Lattice sampling: " << m_samples.size() << " samples generated (spacing " << spacing << ")." << std::endl;
+}
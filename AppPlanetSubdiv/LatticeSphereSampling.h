@@ -0,0 +1,29 @@
+#pragma once
+
+
+#include "tool.h"
+#include <vector>
+
+
+/**
+ * @brief Fast, non blue-noise sampling of the sphere : a jittered Fibonacci lattice, generated in O(n) without any rejection.
+ * Meant for preview planets, where the quality of a Poisson disk sampling is not required.
+ */
+class LatticeSphereSampling
+{
+public:
+	LatticeSphereSampling() {}
+	~LatticeSphereSampling() {}
+
+	/**
+	 * Samples the sphere with about as many points as a Poisson disk sampling of the same radius (see PoissonSphereSampling).
+	 * The 6 octahedron vertices are the first 6 samples, lattice points too close to them are discarded.
+	 * @param jitter Amplitude of the random tangential offset of each lattice point, relative to the lattice spacing.
+	 */
+	void sample(double sphere_radius, double poisson_radius, unsigned int seed = 13337, double jitter = 0.15);
+	inline std::vector<math::dvec3>& getSamples() { return m_samples; }
+
+private:
+
+	std::vector<math::dvec3> m_samples;
+};
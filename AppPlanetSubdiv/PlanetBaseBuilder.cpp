@@ -0,0 +1,1897 @@
+#include "PlanetBaseBuilder.h"
+
+#include "SphericalDelaunay.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+
+
+static double secondsSince(const std::chrono::high_resolution_clock::time_point & start)
+{
+	std::chrono::duration<double> span = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start);
+	return span.count();
+}
+
+void PlanetBaseBuilder::build()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	auto stage = start;
+
+	// the whole base planet of a previous run, if cached:
+	const std::string bake_file = getBakeCacheFile();
+	if (!bake_file.empty() && loadFromBakeFile(bake_file))
+	{
+		tool::recordStage(m_time_data.bake_cache_load, stage, m_base_vertices.size());
+		m_time_data.total_secs = secondsSince(start);
+		std::cout << std::endl << "=====================================================\nLoading the baked planet took : " << m_time_data.total_secs << " seconds.\n=====================================================\n" << std::endl;
+		return;
+	}
+
+	makePoissonDelaunayBaseMesh();
+	m_time_data.base_mesh_secs = secondsSince(stage);
+
+	double minutes = std::floor(m_time_data.base_mesh_secs / 60.0);
+	double seconds = m_time_data.base_mesh_secs - 60.0 * minutes;
+	std::cout << std::endl << "=====================================================\nPoisson sampling, spherical delaunay and mesh conversion took : " << minutes << " minutes " << seconds << " seconds." << std::endl;
+
+	std::cout << "Cleaning up coasts + computing base river network ..." << std::endl;
+	stage = std::chrono::high_resolution_clock::now();
+	createBaseRiverNetwork();
+	m_time_data.river_network_secs = secondsSince(stage);
+
+	stage = std::chrono::high_resolution_clock::now();
+	postprocessBaseRiverNetwork();
+	tool::recordStage(m_time_data.river_postprocess, stage, m_river_nodes_size);
+
+	if (!bake_file.empty())
+		persistToBakeFile(bake_file);
+
+	m_time_data.total_secs = secondsSince(start);
+	minutes = std::floor(m_time_data.total_secs / 60.0);
+	seconds = m_time_data.total_secs - 60.0 * minutes;
+	std::cout << std::endl << "Total took : " << minutes << " minutes " << seconds << " seconds.\n=====================================================\n" << std::endl;
+}
+
+void PlanetBaseBuilder::release()
+{
+	delete[] m_river_nodes;
+	m_river_nodes = nullptr;
+	m_river_nodes_size = 0;
+	m_river_nodes_max_size = 0;
+	m_rivers.clear();
+
+	m_base_edges.clear();
+	m_base_vertices.clear();
+	m_base_triangles.clear();
+	m_base_vattrib.clear();
+	m_vertex_edge_offsets.clear();
+	m_vertex_edges.clear();
+	m_water_body.clear();
+	m_water_body_size.clear();
+}
+
+void PlanetBaseBuilder::makePoissonDelaunayBaseMesh()
+{
+	// Make a Poisson disk sampling of the surface of the planet (optionally sparser in open ocean, or a jittered lattice for previews)
+	// Build a spherical Delaunay triangulation (SDT)
+	// (or reuse the triangulation of a previous run, which only depends on the planet radius and on the sampling parameters)
+	std::unique_ptr<SphericalDelaunay> sdt_storage;
+	const std::string cache_file = getTriangulationCacheFile();
+	if (!cache_file.empty())
+	{
+		auto stage = std::chrono::high_resolution_clock::now();
+		sdt_storage.reset(new SphericalDelaunay);
+		if (sdt_storage->loadFromDisk(cache_file))
+			tool::recordStage(m_time_data.delaunay_cache_load, stage, sdt_storage->getNumVertices());
+		else
+			sdt_storage.reset();
+	}
+	if (!sdt_storage)
+	{
+		PoissonSphereSampling::RadiusFunction radius_function;
+		if (m_max_edge_length_km > MINIMUM_EDGE_LENGTH_KM)
+			radius_function = [this](const math::dvec3 & p) { return getLocalSamplingRadius(p); };
+		sdt_storage.reset(new SphericalDelaunay(m_planet->radiusKm, MINIMUM_EDGE_LENGTH_KM, m_sampling_method, radius_function));
+		m_time_data.poisson_sampling = sdt_storage->getTimeData().sampling;
+#ifdef SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION
+		m_time_data.delaunay_naive_lawson = sdt_storage->getTimeData().naive_lawson;
+#endif
+		m_time_data.delaunay_insertion = sdt_storage->getTimeData().insertion;
+		if (!cache_file.empty())
+			sdt_storage->persistToDisk(cache_file);
+	}
+	const SphericalDelaunay & sdt = *sdt_storage;
+
+	const int vrange = sdt.getVerticesRange();
+	const SphericalVertex * vs = sdt.getVertices();
+	const int trange = sdt.getTrianglesRange();
+	const SphericalTriangle * ts = sdt.getTriangles();
+
+	// deleted slots of the triangulation are skipped : vertices and triangles are compacted, and all their references remapped through these tables
+	std::vector<int> base_vertex_index(vrange, -1), base_triangle_index(trange, -1);
+	int num_base_vertices = 0, num_base_triangles = 0;
+	for (int i = 0; i < vrange; ++i)
+		if (!VERTEX_DELETED(vs[i]))
+			base_vertex_index[i] = num_base_vertices++;
+	for (int i = 0; i < trange; ++i)
+		if (!TRIANGLE_DELETED(ts[i]))
+			base_triangle_index[i] = num_base_triangles++;
+
+	// Edges construction:
+	// each edge is emitted once, by the lower indexed of its two triangles (the neighbor links give the other one), and its index is written for both triangles
+	auto stage = std::chrono::high_resolution_clock::now();
+	std::vector<int> triangle_edges(3 * trange, -1);// edges of each triangle, in TriangleGPU order : (v0, v1), (v1, v2), (v2, v0)
+	m_base_edges.reserve(3 * sdt.getNumTriangles() / 2);
+	m_base_triangles.reserve(num_base_triangles);
+	for (int i = 0; i < trange; ++i)
+	{
+		const SphericalTriangle & T = ts[i];
+		if (TRIANGLE_DELETED(T))
+			continue;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			const int j = T.neighbor[k];// across the edge (vertex[k + 1], vertex[k + 2]), ie. edge (k + 1) % 3 of TriangleGPU
+			if (j != -1 && j < i)
+				continue;
+
+			EdgeGPU E{};// value-initialized : no undefined bytes (padding) in the baked planet files
+			E.child0 = -1;
+			E.child1 = -1;
+			E.vm = -1;
+			E.f0 = base_triangle_index[i];
+			E.f1 = j == -1 ? -1 : base_triangle_index[j];
+			E.status = (8u << 16);
+			E.v0 = base_vertex_index[T.vertex[(k + 1) % 3]];
+			E.v1 = base_vertex_index[T.vertex[(k + 2) % 3]];
+			E.type = TYPE_NONE;
+
+			const int edge_index = (int)m_base_edges.size();
+			m_base_edges.push_back(E);
+			triangle_edges[3 * i + (k + 1) % 3] = edge_index;
+			if (j != -1)
+			{
+				const SphericalTriangle & N = ts[j];
+				for (int l = 0; l < 3; ++l)
+					if (N.vertex[l] != T.vertex[(k + 1) % 3] && N.vertex[l] != T.vertex[(k + 2) % 3])
+						triangle_edges[3 * j + (l + 1) % 3] = edge_index;
+			}
+		}
+	}
+	tool::recordStage(m_time_data.edge_build, stage, m_base_edges.size());
+
+	// --- Assign Vertices and Vertex Attributes ---
+	// in parallel : the planet data queries are read-only, and the random numbers are counter-based (drawn from the vertex index), so the result does not depend on the number of threads
+	stage = std::chrono::high_resolution_clock::now();
+	std::vector<int> incident_offsets, incident_triangles;
+	sdt.getVertexTriangles(incident_offsets, incident_triangles);
+	m_base_vertices.resize(num_base_vertices);
+	m_base_vattrib.resize(num_base_vertices);
+
+	std::atomic<int> next_block(0);
+	auto worker = [&]()
+	{
+		for (int begin = next_block.fetch_add(BASE_VERTEX_SAMPLING_BLOCK_SIZE); begin < vrange; begin = next_block.fetch_add(BASE_VERTEX_SAMPLING_BLOCK_SIZE))
+		{
+			const int end = std::min(begin + BASE_VERTEX_SAMPLING_BLOCK_SIZE, vrange);
+			for (int i = begin; i < end; ++i)
+			{
+				const SphericalVertex & vertex = vs[i];
+				if (VERTEX_DELETED(vertex))
+					continue;
+
+				math::dvec3 p = math::normalize(vertex.coordinates);
+
+				const PlanetData::Data data = m_planet->getInterpolatedModelData(p);
+				const float plateaux = m_planet->getPlateauxDistribution(p);
+				const float desert = m_planet->getDesertDistribution(p);
+				const float hills = m_planet->getHillsDistribution(p);
+				double r = (double)(tool::counterRandom(BASE_VERTEX_RANDOM_SEED, 2 * (uint64_t)i) % 65536) / 65535.0;
+				double elevation = m_planet->seaLevelKm + (data.elevation - m_planet->seaLevelKm) * (0.7 + 0.3*r);// math::mix(0.4 + 0.6*r, 0.88 - 0.2*r, (double)plateaux); // RANDOMIZE (OR NOT)
+				if (data.elevation <= m_planet->seaLevelKm)
+					elevation = data.elevation;
+				p *= m_planet->radiusKm + elevation;
+				const float tectonic_age = (float)(data.age);
+
+				m_base_vattrib[base_vertex_index[i]] =
+					{
+					math::dvec4(p, elevation)
+					, math::dvec4(m_planet->seaLevelKm /* nearest river altitude : ad hoc value*/
+						, MINIMUM_EDGE_LENGTH_KM /* distance to river: ad hoc value */
+						, data.elevation /* max crust elevation */
+						, m_planet->seaLevelKm) /* water altitude : ad hoc value*/
+					, math::vec4(0.0f, 0.0f, 0.0f, 0.0f) // water flow : ad hoc value
+					, math::vec4((float)(m_planet->seaLevelKm) /* nearest ravin altitude : ad hoc value*/
+						, MINIMUM_EDGE_LENGTH_KM /* distance to ravin : ad hoc value */
+						, hills, 0.0f)
+					, math::vec4(tectonic_age, plateaux, desert, 0.0f)
+					, math::vec4(0.0)
+					};
+
+				//---
+				VertexGPU V{};// value-initialized : no undefined bytes (padding1) in the baked planet files
+				V.branch_count = 0;
+				V.seed = tool::counterRandom(BASE_VERTEX_RANDOM_SEED, 2 * (uint64_t)i + 1) >> 1;// same range as std::rand
+				if (V.seed == 0)
+					V.seed = 1337;
+				V.status = 0;
+				if (elevation > m_planet->seaLevelKm)
+					V.type = TYPE_CONTINENT;
+				else V.type = TYPE_SEA;
+
+				// incident faces, in counterclockwise order (at most 8)
+				for (int k = 0; k < 4; ++k)
+				{
+					V.faces_0[k] = -1;
+					V.faces_1[k] = -1;
+				}
+				const int face_count = std::min(incident_offsets[i + 1] - incident_offsets[i], 8);
+				for (int k = 0; k < face_count; ++k)
+				{
+					const int t = base_triangle_index[incident_triangles[incident_offsets[i] + k]];
+					if (k < 4)
+						V.faces_0[k] = t;
+					else
+						V.faces_1[k - 4] = t;
+				}
+
+				m_base_vertices[base_vertex_index[i]] = V;
+			}
+		}
+	};
+	const unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < num_threads; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread & thread : threads)
+		thread.join();
+	tool::recordStage(m_time_data.vertex_sampling, stage, m_base_vertices.size());
+
+	// --- Assign Triangles ---
+	for (int i = 0; i < trange; ++i)
+	{
+		const SphericalTriangle & T = ts[i];
+		if (TRIANGLE_DELETED(T))
+			continue;
+
+		TriangleGPU t;
+		t.e0 = triangle_edges[3 * i];
+		t.e1 = triangle_edges[3 * i + 1];
+		t.e2 = triangle_edges[3 * i + 2];
+
+		t.normal_x = 0.0f;
+		t.normal_y = 0.0f;
+		t.normal_z = 0.0f;
+
+		t.status = (8u << 8);
+		t.type = TYPE_NONE;
+
+		m_base_triangles.push_back(t);
+	}
+
+#ifdef BASE_MESH_HILBERT_ORDER
+	stage = std::chrono::high_resolution_clock::now();
+	reorderBaseMesh();
+	tool::recordStage(m_time_data.mesh_reorder, stage, m_base_vertices.size());
+#endif
+
+	// --
+	double avg_edge_len = sdt.getAverageTriangleEdgeLength();
+	std::cout << "BASE MESH : " << avg_edge_len << " average edge (km), " << m_base_triangles.size() << " triangles for last and only base LOD." << std::endl;
+}
+
+void PlanetBaseBuilder::reorderBaseMesh()
+{
+	const int num_vertices = (int)m_base_vertices.size();
+	const int num_edges = (int)m_base_edges.size();
+	const int num_triangles = (int)m_base_triangles.size();
+
+	// new index of each element (remap[old index] = new index), sorted by key
+	auto sortByKey = [](std::vector<std::pair<uint64_t, int>> & keys, std::vector<int> & remap)
+	{
+		std::sort(keys.begin(), keys.end());
+		remap.resize(keys.size());
+		for (int i = 0; i < (int)keys.size(); ++i)
+			remap[keys[i].second] = i;
+	};
+	std::vector<std::pair<uint64_t, int>> keys;
+	std::vector<int> vertex_remap, edge_remap, triangle_remap;
+
+	keys.resize(num_vertices);
+	for (int i = 0; i < num_vertices; ++i)
+		keys[i] = std::make_pair(tool::hilbertKey(math::normalize(math::dvec3(m_base_vattrib[i].position)), math::dvec3(0.0), 1.0), i);
+	sortByKey(keys, vertex_remap);
+
+	// edges by (first, second) vertex, triangles by first vertex (ties keep the former order)
+	keys.resize(num_edges);
+	for (int i = 0; i < num_edges; ++i)
+	{
+		const uint64_t v0 = (uint64_t)vertex_remap[m_base_edges[i].v0], v1 = (uint64_t)vertex_remap[m_base_edges[i].v1];
+		keys[i] = std::make_pair((std::min(v0, v1) << 32) | std::max(v0, v1), i);
+	}
+	sortByKey(keys, edge_remap);
+
+	keys.resize(num_triangles);
+	for (int i = 0; i < num_triangles; ++i)
+	{
+		const TriangleGPU & T = m_base_triangles[i];
+		int first = INT_MAX;
+		for (int e : { T.e0, T.e1, T.e2 })
+			first = std::min(first, std::min(vertex_remap[m_base_edges[e].v0], vertex_remap[m_base_edges[e].v1]));
+		keys[i] = std::make_pair(((uint64_t)first << 32) | (uint64_t)i, i);
+	}
+	sortByKey(keys, triangle_remap);
+	keys.clear();
+	keys.shrink_to_fit();
+
+	// in place permutation, cycle by cycle (the arrays are large, do not copy them)
+	std::vector<int> cycle;
+	auto permute = [&cycle](const std::vector<int> & remap, auto swap_elements)
+	{
+		cycle = remap;
+		for (int i = 0; i < (int)cycle.size(); ++i)
+			while (cycle[i] != i)
+			{
+				const int j = cycle[i];
+				swap_elements(i, j);
+				std::swap(cycle[i], cycle[j]);
+			}
+	};
+	auto remapIndex = [](int index, const std::vector<int> & remap) { return index == -1 ? -1 : remap[index]; };
+
+	permute(vertex_remap, [this](int i, int j) { std::swap(m_base_vertices[i], m_base_vertices[j]); std::swap(m_base_vattrib[i], m_base_vattrib[j]); });
+	for (VertexGPU & V : m_base_vertices)
+		for (int k = 0; k < 4; ++k)
+		{
+			V.faces_0[k] = remapIndex(V.faces_0[k], triangle_remap);
+			V.faces_1[k] = remapIndex(V.faces_1[k], triangle_remap);
+		}
+
+	permute(edge_remap, [this](int i, int j) { std::swap(m_base_edges[i], m_base_edges[j]); });
+	for (EdgeGPU & E : m_base_edges)
+	{
+		E.v0 = vertex_remap[E.v0];
+		E.v1 = vertex_remap[E.v1];
+		E.f0 = remapIndex(E.f0, triangle_remap);
+		E.f1 = remapIndex(E.f1, triangle_remap);
+	}
+
+	permute(triangle_remap, [this](int i, int j) { std::swap(m_base_triangles[i], m_base_triangles[j]); });
+	for (TriangleGPU & T : m_base_triangles)
+	{
+		T.e0 = edge_remap[T.e0];
+		T.e1 = edge_remap[T.e1];
+		T.e2 = edge_remap[T.e2];
+	}
+}
+
+std::string PlanetBaseBuilder::getTriangulationCacheFile() const
+{
+	// adaptive density depends on the planet data, not only on the sampling parameters : not cached
+	if (m_sdt_cache_directory.empty() || m_max_edge_length_km > MINIMUM_EDGE_LENGTH_KM)
+		return std::string();
+
+	std::string directory = m_sdt_cache_directory;
+	const char last = directory.back();
+	if (last != '/' && last != '\\')
+		directory += '/';
+	std::ostringstream name;
+	name << directory << "base_" << m_planet->radiusKm << "km_" << MINIMUM_EDGE_LENGTH_KM << "km_" << (m_sampling_method == SphereSamplingMethod::LATTICE ? "lattice" : "poisson") << ".sdt";
+	return name.str();
+}
+
+uint64_t PlanetBaseBuilder::getBakeKey() const
+{
+	struct
+	{
+		uint64_t input_hash;
+		double radius_km, sea_level_km, max_altitude;
+		double min_edge_length_km, max_edge_length_km;
+		uint32_t planet_seed, vertex_seed, river_seed, sampling_method, options, version, sdt_version;
+	} key;
+	std::memset(&key, 0, sizeof(key));// no uninitialized padding in the hash
+	key.input_hash = m_planet->getInputHash();
+	key.radius_km = m_planet->radiusKm;
+	key.sea_level_km = m_planet->seaLevelKm;
+	key.max_altitude = m_planet->maxAltitude;
+	key.min_edge_length_km = MINIMUM_EDGE_LENGTH_KM;
+	key.max_edge_length_km = getMaximumEdgeLength();
+	key.planet_seed = m_planet->seed;
+	key.vertex_seed = BASE_VERTEX_RANDOM_SEED;
+	key.river_seed = BASE_RIVER_RANDOM_SEED;
+	key.sampling_method = (uint32_t)m_sampling_method;
+#ifdef BASE_MESH_HILBERT_ORDER
+	key.options |= 1u;
+#endif
+#ifdef BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS
+	key.options |= 2u;
+#endif
+	key.version = PLANET_BAKE_FILE_VERSION;
+	key.sdt_version = SDT_FILE_VERSION;
+	return tool::checksum64(&key, sizeof(key));
+}
+
+std::string PlanetBaseBuilder::getBakeCacheFile() const
+{
+	// nothing identifies the planet if it was not loaded from files
+	if (m_bake_cache_directory.empty() || m_planet->getInputHash() == 0)
+		return std::string();
+
+	std::string directory = m_bake_cache_directory;
+	const char last = directory.back();
+	if (last != '/' && last != '\\')
+		directory += '/';
+	std::ostringstream name;
+	name << directory << "planet_" << std::hex << std::setw(16) << std::setfill('0') << getBakeKey() << ".pbk";
+	return name.str();
+}
+
+static inline uint64_t alignBakeSection(uint64_t offset)
+{
+	return (offset + PLANET_BAKE_FILE_SECTION_ALIGNMENT - 1) / PLANET_BAKE_FILE_SECTION_ALIGNMENT * PLANET_BAKE_FILE_SECTION_ALIGNMENT;
+}
+
+bool PlanetBaseBuilder::loadFromBakeFile(const std::string & filename)
+{
+	std::ifstream file(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!file.good())
+		return false;// not baked yet
+	std::cout << "Loading baked planet from disk (" << filename << ")... " << std::endl;
+	file.seekg(0, std::ifstream::end);
+	const uint64_t file_size = (uint64_t)file.tellg();
+	file.seekg(0, std::ifstream::beg);
+
+	// validate the header and the layout of the sections before reading them:
+	const char * error = nullptr;
+	PlanetBakeFileHeader header;
+	uint64_t section_bytes[6] = {};
+	if (file_size < sizeof(header) || !file.read((char*)&header, sizeof(header)))
+		error = "truncated header";
+	else
+	{
+		section_bytes[0] = (uint64_t)header.num_edges * sizeof(EdgeGPU);
+		section_bytes[1] = (uint64_t)header.num_vertices * sizeof(VertexGPU);
+		section_bytes[2] = (uint64_t)header.num_triangles * sizeof(TriangleGPU);
+		section_bytes[3] = (uint64_t)header.num_vertices * sizeof(VertexAttributesGPU);
+		section_bytes[4] = (uint64_t)header.num_river_nodes * sizeof(RiverNode);
+		section_bytes[5] = (uint64_t)header.num_rivers * sizeof(int);
+		bool layout = header.file_size == file_size;
+		uint64_t end = sizeof(header);
+		for (int s = 0; s < 6 && layout; ++s)
+		{
+			layout = header.section_offset[s] % PLANET_BAKE_FILE_SECTION_ALIGNMENT == 0 && header.section_offset[s] >= end && header.section_offset[s] + section_bytes[s] <= header.file_size;
+			end = header.section_offset[s] + section_bytes[s];
+		}
+		if (std::memcmp(header.magic, "PBK", 4) != 0)
+			error = "not a .pbk file";
+		else if (header.version != PLANET_BAKE_FILE_VERSION)
+			error = "unsupported version";
+		else if (header.endianness != 0x01020304u || header.header_size != sizeof(PlanetBakeFileHeader) || header.edge_size != sizeof(EdgeGPU) || header.vertex_size != sizeof(VertexGPU)
+			|| header.triangle_size != sizeof(TriangleGPU) || header.vattrib_size != sizeof(VertexAttributesGPU) || header.river_node_size != sizeof(RiverNode))
+			error = "written by an incompatible host";
+		else if (header.key != getBakeKey())
+			error = "baked from other inputs";
+		else if (!layout)
+			error = "corrupted section layout";
+	}
+	if (error != nullptr)
+	{
+		std::cout << "ERROR - " << filename << " : " << error << std::endl;
+		return false;
+	}
+
+	// read the sections straight into the arrays (the arrays are modified afterwards, so they can not live in a mapped file), then check them:
+	release();
+	m_base_edges.resize(header.num_edges);
+	m_base_vertices.resize(header.num_vertices);
+	m_base_triangles.resize(header.num_triangles);
+	m_base_vattrib.resize(header.num_vertices);
+	m_river_nodes_size = (int)header.num_river_nodes;
+	m_river_nodes_max_size = std::max((int)header.num_river_nodes, (int)header.num_vertices);
+	m_river_nodes = new RiverNode[m_river_nodes_max_size];
+	std::vector<int> rivers(header.num_rivers);
+	char * sections[6] = { (char*)m_base_edges.data(), (char*)m_base_vertices.data(), (char*)m_base_triangles.data(), (char*)m_base_vattrib.data(), (char*)m_river_nodes, (char*)rivers.data() };
+	uint64_t checksums[6];
+	for (int s = 0; s < 6; ++s)
+	{
+		file.seekg(header.section_offset[s]);
+		file.read(sections[s], section_bytes[s]);
+		checksums[s] = tool::checksum64(sections[s], (size_t)section_bytes[s]);
+	}
+	if (!file)
+		error = "truncated section";
+	else if (header.checksum != tool::checksum64(checksums, sizeof(checksums)))
+		error = "checksum mismatch";
+	if (error != nullptr)
+	{
+		std::cout << "ERROR - " << filename << " : " << error << std::endl;
+		release();
+		return false;
+	}
+	m_rivers.assign(rivers.begin(), rivers.end());
+
+	return true;
+}
+
+bool PlanetBaseBuilder::persistToBakeFile(const std::string & filename) const
+{
+	std::cout << "Persisting baked planet to disk (" << filename << ")... " << std::endl;
+	std::ofstream file(filename.c_str(), std::ofstream::out | std::ofstream::binary);
+	if (!file.good())
+	{
+		std::cout << "ERROR - failed opening " << filename << std::endl;
+		return false;
+	}
+
+	// [header | padding | edges | padding | vertices | ... | river mouths], see PlanetBakeFileHeader
+	const std::vector<int> rivers(m_rivers.begin(), m_rivers.end());
+	const char * sections[6] = { (const char*)m_base_edges.data(), (const char*)m_base_vertices.data(), (const char*)m_base_triangles.data(),
+		(const char*)m_base_vattrib.data(), (const char*)m_river_nodes, (const char*)rivers.data() };
+	const uint64_t section_bytes[6] = { m_base_edges.size() * sizeof(EdgeGPU), m_base_vertices.size() * sizeof(VertexGPU), m_base_triangles.size() * sizeof(TriangleGPU),
+		m_base_vattrib.size() * sizeof(VertexAttributesGPU), (uint64_t)m_river_nodes_size * sizeof(RiverNode), rivers.size() * sizeof(int) };
+
+	PlanetBakeFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "PBK", 4);
+	header.version = PLANET_BAKE_FILE_VERSION;
+	header.endianness = 0x01020304u;
+	header.header_size = sizeof(PlanetBakeFileHeader);
+	header.edge_size = sizeof(EdgeGPU);
+	header.vertex_size = sizeof(VertexGPU);
+	header.triangle_size = sizeof(TriangleGPU);
+	header.vattrib_size = sizeof(VertexAttributesGPU);
+	header.river_node_size = sizeof(RiverNode);
+	header.num_edges = (uint32_t)m_base_edges.size();
+	header.num_vertices = (uint32_t)m_base_vertices.size();
+	header.num_triangles = (uint32_t)m_base_triangles.size();
+	header.num_river_nodes = (uint32_t)m_river_nodes_size;
+	header.num_rivers = (uint32_t)rivers.size();
+	header.key = getBakeKey();
+	uint64_t offset = sizeof(header);
+	uint64_t checksums[6];
+	for (int s = 0; s < 6; ++s)
+	{
+		header.section_offset[s] = alignBakeSection(offset);
+		offset = header.section_offset[s] + section_bytes[s];
+		checksums[s] = tool::checksum64(sections[s], (size_t)section_bytes[s]);
+	}
+	header.file_size = offset;
+	header.checksum = tool::checksum64(checksums, sizeof(checksums));
+
+	const char zeros[PLANET_BAKE_FILE_SECTION_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(header));
+	offset = sizeof(header);
+	for (int s = 0; s < 6; ++s)
+	{
+		file.write(zeros, header.section_offset[s] - offset);
+		file.write(sections[s], section_bytes[s]);
+		offset = header.section_offset[s] + section_bytes[s];
+	}
+	file.close();
+	if (file.fail())
+	{
+		std::cout << "ERROR - failed writing " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+double PlanetBaseBuilder::getLocalSamplingRadius(const math::dvec3 & p) const
+{
+	const PlanetData::Data data = m_planet->getInterpolatedModelData(p);
+	const double depth = m_planet->seaLevelKm - data.elevation;
+
+	// 0 on land, coasts and continental shelves, up to 1 in deep unstrained ocean
+	double sparse = math::clamp((depth - ADAPTIVE_DENSITY_SHELF_DEPTH_KM) / (ADAPTIVE_DENSITY_OCEAN_DEPTH_KM - ADAPTIVE_DENSITY_SHELF_DEPTH_KM), 0.0, 1.0);
+	sparse = sparse * sparse * (3.0 - 2.0 * sparse);
+	sparse *= 1.0 - math::clamp(data.strain_level, 0.0, 1.0);
+
+	return MINIMUM_EDGE_LENGTH_KM + sparse * (m_max_edge_length_km - MINIMUM_EDGE_LENGTH_KM);
+}
+
+/**
+ * Labels the connected components of the base vertices for which inside(v) holds, joined by the edges whose two vertices are inside (union-find, union by size and path halving).
+ * label[v] is the component of v, or -1 if v is not inside ; components are numbered by increasing first vertex, sizes[c] is the number of vertices of component c.
+ */
+template <typename Inside>
+static void labelVertexComponents(const std::vector<EdgeGPU> & edges, int num_vertices, Inside inside, std::vector<int> & label, std::vector<int> & sizes)
+{
+	std::vector<int> parent(num_vertices), size(num_vertices, 1);
+	for (int v = 0; v < num_vertices; ++v)
+		parent[v] = v;
+	auto find = [&parent](int v)
+	{
+		while (parent[v] != v)
+		{
+			parent[v] = parent[parent[v]];
+			v = parent[v];
+		}
+		return v;
+	};
+	for (const EdgeGPU & E : edges)
+	{
+		if (!inside(E.v0) || !inside(E.v1))
+			continue;
+		int r0 = find(E.v0), r1 = find(E.v1);
+		if (r0 == r1)
+			continue;
+		if (size[r0] < size[r1])
+			std::swap(r0, r1);
+		parent[r1] = r0;
+		size[r0] += size[r1];
+	}
+
+	// compact labels, by first vertex of each component
+	label.assign(num_vertices, -1);
+	sizes.clear();
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		if (!inside(v))
+			continue;
+		const int root = find(v);
+		if (label[root] == -1)
+		{
+			label[root] = (int)sizes.size();
+			sizes.push_back(size[root]);
+		}
+		label[v] = label[root];
+	}
+}
+
+void PlanetBaseBuilder::labelWaterBodies()
+{
+	labelVertexComponents(m_base_edges, (int)m_base_vertices.size(), [this](int v) { return m_base_vertices[v].type == TYPE_SEA; }, m_water_body, m_water_body_size);
+}
+
+bool PlanetBaseBuilder::isTriangleSeaCoast(int triangle_index) const
+{
+	const TriangleGPU & T = m_base_triangles[triangle_index];
+	const EdgeGPU & e0 = m_base_edges[T.e0];
+	const EdgeGPU & e1 = m_base_edges[T.e1];
+	const EdgeGPU & e2 = m_base_edges[T.e2];
+
+	bool flip0 = false;
+	bool flip1 = false;
+	bool flip2 = false;//determine winding of edges (as they can appear in any order)
+	if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
+		flip0 = true;
+	if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
+		flip1 = true;
+	if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
+		flip2 = true;
+	int v0 = (flip0 ? e0.v1 : e0.v0);
+	int v1 = (flip1 ? e1.v1 : e1.v0);
+	int v2 = (flip2 ? e2.v1 : e2.v0);
+	
+	// sum the sizes of the distinct water bodies around the triangle (each body counts at least one vertex, so that SEA_MIN_WATER_BODY_SIZE bodies always decide)
+	int bodies[SEA_MIN_WATER_BODY_SIZE];
+	int num_bodies = 0, water_size = 0;
+	auto addWaterBody = [&](int w)
+	{
+		const int body = m_water_body[w];
+		if (body == -1 || std::find(bodies, bodies + num_bodies, body) != bodies + num_bodies)
+			return;
+		bodies[num_bodies++] = body;
+		water_size += m_water_body_size[body];
+	};
+	for (int v : { v0, v1, v2 })
+	{
+		addWaterBody(v);
+		for (int k = m_vertex_edge_offsets[v]; k < m_vertex_edge_offsets[v + 1] && water_size < SEA_MIN_WATER_BODY_SIZE; ++k)
+			addWaterBody(m_vertex_edges[k].vertex);
+		if (water_size >= SEA_MIN_WATER_BODY_SIZE)
+			return true;
+	}
+	return false;
+}
+
+void PlanetBaseBuilder::createAllRiverMouth(std::vector<RiverGrowingNode> & nodes)
+{
+	std::mt19937 prng;
+	std::vector<int> coasts;
+
+	// -- assign triangle types and save aside coast triangles --
+	for (int i = 0; i < m_base_triangles.size(); ++i)
+	{
+		TriangleGPU & T = m_base_triangles[i];
+		if ((T.status & 0xFF) != 0)
+			continue;
+
+		EdgeGPU & e0 = m_base_edges[T.e0];
+		EdgeGPU & e1 = m_base_edges[T.e1];
+		EdgeGPU & e2 = m_base_edges[T.e2];
+
+		bool flip0 = false;
+		bool flip1 = false;
+		bool flip2 = false;//determine winding of edges (as they can appear in any order)
+		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
+			flip0 = true;
+		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
+			flip1 = true;
+		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
+			flip2 = true;
+		int v0 = (flip0 ? e0.v1 : e0.v0);
+		int v1 = (flip1 ? e1.v1 : e1.v0);
+		int v2 = (flip2 ? e2.v1 : e2.v0);
+		VertexGPU & V0 = m_base_vertices[v0];
+		VertexGPU & V1 = m_base_vertices[v1];
+		VertexGPU & V2 = m_base_vertices[v2];
+
+		int count = 0;
+		if (V0.type == TYPE_SEA)
+			count++;
+		if (V1.type == TYPE_SEA) // sea vertex
+			count++;
+		if (V2.type == TYPE_SEA) // sea vertex
+			count++;
+		if (count == 0)
+		{
+			T.type = TYPE_CONTINENT;
+			continue;
+		}
+		if (count == 3)
+		{
+			T.type = TYPE_SEA;
+			continue;
+		}
+
+		T.type = TYPE_COAST;
+		if (count == 2)
+			coasts.push_back(i);
+	}
+
+	// -- make clean coast triangles (ie., without any sea vertex) --
+	for (int t : coasts)
+	{
+		TriangleGPU & T = m_base_triangles[t];
+		EdgeGPU & e0 = m_base_edges[T.e0];
+		EdgeGPU & e1 = m_base_edges[T.e1];
+		EdgeGPU & e2 = m_base_edges[T.e2];
+
+		bool flip0 = false;
+		bool flip1 = false;
+		bool flip2 = false;//determine winding of edges (as they can appear in any order)
+		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
+			flip0 = true;
+		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
+			flip1 = true;
+		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
+			flip2 = true;
+		int v0 = (flip0 ? e0.v1 : e0.v0);
+		int v1 = (flip1 ? e1.v1 : e1.v0);
+		int v2 = (flip2 ? e2.v1 : e2.v0);
+		VertexGPU & V0 = m_base_vertices[v0];
+		VertexGPU & V1 = m_base_vertices[v1];
+		VertexGPU & V2 = m_base_vertices[v2];
+
+		int cv;
+		if (V0.type == TYPE_CONTINENT)
+			cv = v0;
+		else if (V1.type == TYPE_CONTINENT)
+			cv = v1;
+		else cv = v2;
+		const double ref_altitude = m_base_vattrib[cv].position.w;
+
+		if (V0.type == TYPE_SEA)
+		{
+			V0.type = TYPE_COAST;
+			math::dvec4 va = m_base_vattrib[v0].position;
+			math::dvec4 vd = m_base_vattrib[v0].data;
+			m_base_vattrib[v0].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
+			math::dvec3 p(va);
+			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
+			m_base_vattrib[v0].position = math::dvec4(p, ref_altitude);			
+		}
+		if (V1.type == TYPE_SEA)
+		{
+			V1.type = TYPE_COAST;
+			math::dvec4 va = m_base_vattrib[v1].position;
+			math::dvec4 vd = m_base_vattrib[v1].data;
+			m_base_vattrib[v1].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
+			math::dvec3 p(va);
+			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
+			m_base_vattrib[v1].position = math::dvec4(p, ref_altitude);
+		}
+		if (V2.type == TYPE_SEA)
+		{
+			V2.type = TYPE_COAST;
+			math::dvec4 va = m_base_vattrib[v2].position;
+			math::dvec4 vd = m_base_vattrib[v2].data;
+			m_base_vattrib[v2].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
+			math::dvec3 p(va);
+			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
+			m_base_vattrib[v2].position = math::dvec4(p, ref_altitude);
+		}
+	}
+
+	// -- create starting point for rivers (river mouth) --
+	labelWaterBodies();// (sea vertices do not change anymore)
+	for (int i : coasts)
+	{
+		TriangleGPU & T = m_base_triangles[i];
+		EdgeGPU & e0 = m_base_edges[T.e0];
+		EdgeGPU & e1 = m_base_edges[T.e1];
+		EdgeGPU & e2 = m_base_edges[T.e2];
+
+		bool flip0 = false;
+		bool flip1 = false;
+		bool flip2 = false;//determine winding of edges (as they can appear in any order)
+		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
+			flip0 = true;
+		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
+			flip1 = true;
+		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
+			flip2 = true;
+		int v0 = (flip0 ? e0.v1 : e0.v0);
+		int v1 = (flip1 ? e1.v1 : e1.v0);
+		int v2 = (flip2 ? e2.v1 : e2.v0);
+		VertexGPU & V0 = m_base_vertices[v0];
+		VertexGPU & V1 = m_base_vertices[v1];
+		VertexGPU & V2 = m_base_vertices[v2];
+		
+		if (V0.type == TYPE_RIVER || V1.type == TYPE_RIVER || V2.type == TYPE_RIVER)
+			continue;
+
+		double a0 = m_base_vattrib[v0].position.w - m_planet->seaLevelKm;
+		double a1 = m_base_vattrib[v1].position.w - m_planet->seaLevelKm;
+		double a2 = m_base_vattrib[v2].position.w - m_planet->seaLevelKm;
+		//if (a0 > 1.7 && a1 > 1.7 && a2 > 1.7)// make sure mountainous coast (1700 m) don't become river mouth
+			//continue;
+
+		if (V0.type == TYPE_COAST)
+		{// make sure no neighbor vertex is of type River:
+			bool nogood = false;
+			for (int k = m_vertex_edge_offsets[v0]; k < m_vertex_edge_offsets[v0 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_RIVER)
+				{
+					nogood = true;
+					break;
+				}
+			}
+			if (nogood)
+				continue;
+		}
+		if (V1.type == TYPE_COAST)
+		{// make sure no neighbor vertex is of type River:
+			bool nogood = false;
+			for (int k = m_vertex_edge_offsets[v1]; k < m_vertex_edge_offsets[v1 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_RIVER)
+				{
+					nogood = true;
+					break;
+				}
+			}
+			if (nogood)
+				continue;
+		}
+		if (V2.type == TYPE_COAST)
+		{// make sure no neighbor vertex is of type River:
+			bool nogood = false;
+			for (int k = m_vertex_edge_offsets[v2]; k < m_vertex_edge_offsets[v2 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_RIVER)
+				{
+					nogood = true;
+					break;
+				}
+			}
+			if (nogood)
+				continue;
+		}
+		
+		if (!isTriangleSeaCoast(i))
+			continue;
+
+		RiverGrowingNode node;
+		int n0 = e0.f0 == i ? e0.f1 : e0.f0;
+		int n1 = e1.f0 == i ? e1.f1 : e1.f0;
+		int n2 = e2.f0 == i ? e2.f1 : e2.f0;
+		int ne, nv0, nv1;
+		math::dvec3 p;
+		int mouth_index;
+
+		if (m_base_triangles[n0].type == TYPE_SEA && m_base_triangles[n1].type != TYPE_SEA && m_base_triangles[n2].type != TYPE_SEA)
+		{
+			if (V1.type == TYPE_COAST)
+			{
+				ne = T.e1;
+				nv0 = v2;
+				nv1 = v1;
+			}
+			else {
+				ne = T.e2;
+				nv0 = v2;
+				nv1 = v0;
+			}
+			node.edge = ne;
+			node.tip_vertex = nv0;			
+
+			// check that, indeed, the candidate river mouth has a connexion to the sea
+			bool has_sea_outlet = false;
+			for (int k = m_vertex_edge_offsets[nv1]; k < m_vertex_edge_offsets[nv1 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_SEA)
+				{
+					has_sea_outlet = true;
+					break;
+				}
+			}
+			if (!has_sea_outlet)
+				continue;
+
+			// river mouth:
+			mouth_index = nv1;			
+		}
+		else if (m_base_triangles[n1].type == TYPE_SEA && m_base_triangles[n0].type != TYPE_SEA && m_base_triangles[n2].type != TYPE_SEA)
+		{
+			if (V1.type == TYPE_COAST)
+			{
+				ne = T.e0;
+				nv0 = v0;
+				nv1 = v1;
+			}
+			else {
+				ne = T.e2;
+				nv0 = v0;
+				nv1 = v2;
+			}
+			node.edge = ne;
+			node.tip_vertex = nv0;
+
+			// check that, indeed, the candidate river mouth has a connexion to the sea
+			bool has_sea_outlet = false;
+			for (int k = m_vertex_edge_offsets[nv1]; k < m_vertex_edge_offsets[nv1 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_SEA)
+				{
+					has_sea_outlet = true;
+					break;
+				}
+			}
+			if (!has_sea_outlet)
+				continue;
+
+			// river mouth:
+			mouth_index = nv1;
+		}
+		else if (m_base_triangles[n2].type == TYPE_SEA && m_base_triangles[n1].type != TYPE_SEA && m_base_triangles[n0].type != TYPE_SEA)
+		{
+			if (V0.type == TYPE_COAST)
+			{
+				ne = T.e0;
+				nv0 = v1;
+				nv1 = v0;
+			}
+			else {
+				ne = T.e1;
+				nv0 = v1;
+				nv1 = v2;
+			}
+			node.edge = ne;
+			node.tip_vertex = nv0;
+
+			// check that, indeed, the candidate river mouth has a connexion to the sea
+			bool has_sea_outlet = false;
+			for (int k = m_vertex_edge_offsets[nv1]; k < m_vertex_edge_offsets[nv1 + 1]; ++k)
+			{
+				if (m_base_vertices[m_vertex_edges[k].vertex].type == TYPE_SEA)
+				{
+					has_sea_outlet = true;
+					break;
+				}
+			}
+			if (!has_sea_outlet)
+				continue;
+
+			// river mouth:
+			mouth_index = nv1;			
+		}
+		else
+			continue;
+
+		math::dvec4 va = m_base_vattrib[node.tip_vertex].position;
+		double r = (double)(prng() % 65536) / 65535.0;
+		double altitude_tip = (0.99 + 0.005 * r) * m_planet->seaLevelKm;//bottom of river is somewhere in ] -100m, -50m]
+		math::dvec3 p_tip = (m_planet->radiusKm + altitude_tip) * math::normalize(math::dvec3(va));
+
+		node.num_edges_to_mouth = 1.0;
+		node.length_to_mouth = 0.0;
+		r = (double)(prng() % 65536) / 65535.0;
+		r = std::pow(r, 0.75);
+		node.target_river_length = std::max(500.0, r * MAX_RIVER_LENGTH);
+		node.spring = false;
+		node.full_grown = false;
+		node.normalized_tecto_altitude = (m_base_vattrib[node.tip_vertex].data.z - m_planet->seaLevelKm)/ m_planet->maxAltitude;
+		node.priority = 1.0f;// r;
+		node.base_vertex = mouth_index;		
+		const float flowvalue = 0.1f + 0.9f * (float)r * (0.618f + 0.382f * (prng() % 65536) / 65535.0f);
+
+		m_base_vertices[mouth_index].type = TYPE_RIVER;
+		va = m_base_vattrib[mouth_index].position;
+		r = (double)(prng() % 65536) / 65535.0;
+		double altitude_mouth = (0.98 + 0.01 * r) * m_planet->seaLevelKm;// bottom of river mouth is somewhere in ]-100m, -200m]
+		p = (m_planet->radiusKm + altitude_mouth) * math::normalize(math::dvec3(va));
+		m_base_vattrib[mouth_index].position = math::dvec4(p, altitude_mouth);
+		m_base_vattrib[mouth_index].data.x = altitude_mouth;//river bed altitude
+		m_base_vattrib[mouth_index].data.y = 0.0;//distance to river is 0
+		math::vec3 flow_dir = math::vec3(math::normalize(p - p_tip));
+		m_base_vattrib[mouth_index].flow = math::vec4(flow_dir, flowvalue);//normalized direction of the flow and normalized flow quantity
+		m_base_vattrib[mouth_index].misc2.w = (float)r;//random river profile for now.
+		//m_base_vattrib[mouth_index].padding_and_debug.w = (float)(node.target_river_length / MAX_RIVER_LENGTH);
+		m_base_vattrib[mouth_index].padding_and_debug.w = (float)node.priority;
+
+		m_base_edges[node.edge].type = TYPE_RIVER;
+		m_base_vertices[node.tip_vertex].type = TYPE_RIVER;
+		m_base_vattrib[node.tip_vertex].position = math::dvec4(p_tip, altitude_tip);
+		m_base_vattrib[node.tip_vertex].data.x = altitude_tip;
+		m_base_vattrib[node.tip_vertex].data.y = 0.0;		
+		m_base_vattrib[node.tip_vertex].flow = math::vec4(flow_dir, flowvalue);
+		m_base_vattrib[node.tip_vertex].misc2.w = m_base_vattrib[mouth_index].misc2.w;
+		//m_base_vattrib[node.tip_vertex].padding_and_debug.w = (float)(node.target_river_length / MAX_RIVER_LENGTH);
+		m_base_vattrib[node.tip_vertex].padding_and_debug.w = (float)node.priority;
+		node.max_flow_value = flowvalue;
+		nodes.push_back(node);
+	}
+}
+
+/// entry of the river growth frontier : a growing node and its growth priority
+struct RiverFrontierEntry
+{
+	double priority;
+	int node;
+};
+
+static inline RiverFrontierEntry makeRiverFrontierEntry(const std::vector<RiverGrowingNode> & nodes, int node)
+{
+	return { nodes[node].priority * (1.0 - nodes[node].normalized_tecto_altitude), node };
+}
+
+static bool compareRiverFrontierEntry(const RiverFrontierEntry & A, const RiverFrontierEntry & B)
+{// max-heap on the priority, the oldest node first among equal priorities
+	return A.priority < B.priority || (A.priority == B.priority && A.node > B.node);
+}
+
+static bool compareBaseRiverNode(const RiverGrowingNode & A, const RiverGrowingNode & B)
+{
+	return A.choice_penalty < B.choice_penalty;
+}
+
+/// the river systems of one land mass, grown independently of the other land masses
+struct RiverRegion
+{
+	int land_mass;
+	std::vector<RiverGrowingNode> mouths;
+	std::vector<int> river_systems;// river_system_id of each mouth
+	std::vector<RiverNode> river_nodes;// indexed locally to the region (the mouth of river system k is river node 2 * k)
+};
+
+void PlanetBaseBuilder::createBaseRiverNetwork()
+{
+	MAX_RIVER_LENGTH = m_planet->radiusKm * 1.6;
+
+	std::vector<RiverGrowingNode> mouths;
+	
+	// -- track elevated base vertices (aka mountain vertices) --
+#ifdef BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS
+	struct MountainVertex
+	{
+		math::dvec4 position;
+		int index;
+	};
+	std::vector<MountainVertex> mountains;
+	mountains.reserve((int)std::sqrt((double)m_base_vertices.size()));
+	for (int i = 0; i < m_base_vertices.size(); ++i)
+	{
+		math::dvec4 p = m_base_vattrib[i].position;
+		if (p.w > m_planet->seaLevelKm + 1.0) // above 1000m altitude
+		{
+			mountains.push_back({ p, i });
+		}
+	}
+#endif
+
+	// -- assign all river mouth (and make clear cut coasts) -- 
+	auto stage = std::chrono::high_resolution_clock::now();
+	buildVertexEdges();
+	createAllRiverMouth(mouths);
+	tool::recordStage(m_time_data.river_mouths, stage, mouths.size());
+	stage = std::chrono::high_resolution_clock::now();
+	const unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<std::thread> threads;
+
+	// -- river tip eligibility, one bit per vertex --
+	// a vertex can become a river tip if it is a continent vertex and if none of its edges touches a sea vertex or a non continent triangle (no river springs near the coast).
+	// triangle types and sea vertices do not change while rivers grow : only the first condition is updated, when a vertex turns into TYPE_RIVER.
+	// (atomic words : the vertices of a word may belong to land masses grown by different threads)
+	const int num_vertices = (int)m_base_vertices.size();
+	std::vector<std::atomic<uint64_t>> tip_eligible((num_vertices + 63) / 64);
+	std::atomic<int> next_block(0);
+	auto worker = [&]()
+	{
+		for (int begin = next_block.fetch_add(RIVER_TIP_MASK_BLOCK_SIZE); begin < num_vertices; begin = next_block.fetch_add(RIVER_TIP_MASK_BLOCK_SIZE))
+		{
+			const int end = std::min(begin + RIVER_TIP_MASK_BLOCK_SIZE, num_vertices);
+			for (int word = begin; word < end; word += 64)
+			{
+				uint64_t bits = 0;
+				for (int w = word; w < std::min(word + 64, end); ++w)
+				{
+					if (m_base_vertices[w].type != TYPE_CONTINENT)
+						continue;
+					bool eligible = true;
+					for (int k = m_vertex_edge_offsets[w]; k < m_vertex_edge_offsets[w + 1] && eligible; ++k)
+					{
+						const EdgeGPU & edge = m_base_edges[m_vertex_edges[k].edge];
+						eligible = m_base_vertices[m_vertex_edges[k].vertex].type != TYPE_SEA && m_base_triangles[edge.f0].type == TYPE_CONTINENT && m_base_triangles[edge.f1].type == TYPE_CONTINENT;
+					}
+					if (eligible)
+						bits |= uint64_t(1) << (w & 63);
+				}
+				tip_eligible[word >> 6].store(bits, std::memory_order_relaxed);
+			}
+		}
+	};
+	for (unsigned int t = 1; t < num_threads; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread & thread : threads)
+		thread.join();
+	threads.clear();
+	auto isTipEligible = [&tip_eligible](int w) { return ((tip_eligible[w >> 6].load(std::memory_order_relaxed) >> (w & 63)) & 1) != 0; };
+	auto makeRiverVertex = [this, &tip_eligible](int w)
+	{
+		m_base_vertices[w].type = TYPE_RIVER;
+		tip_eligible[w >> 6].fetch_and(~(uint64_t(1) << (w & 63)), std::memory_order_relaxed);
+	};
+
+	// -- independent drainage regions --
+	// rivers start from the mouth tips and only grow onto eligible vertices : the river systems of distinct components of these vertices never touch the same vertex, edge or river node.
+	// (this splits the land masses further than the sea does, at straits and narrow isthmuses bordered by coasts)
+	std::vector<char> mouth_tip(num_vertices, 0);
+	for (const RiverGrowingNode & mouth : mouths)
+		mouth_tip[mouth.tip_vertex] = 1;
+	std::vector<int> land_mass, land_mass_size;
+	labelVertexComponents(m_base_edges, num_vertices, [&](int v) { return mouth_tip[v] != 0 || isTipEligible(v); }, land_mass, land_mass_size);
+	std::vector<int> land_mass_region(land_mass_size.size(), -1);
+	std::vector<RiverRegion> regions;
+	for (int c = 0; c < (int)mouths.size(); ++c)
+	{
+		const int l = land_mass[mouths[c].tip_vertex];
+		if (land_mass_region[l] == -1)
+		{
+			land_mass_region[l] = (int)regions.size();
+			regions.emplace_back();
+			regions.back().land_mass = l;
+		}
+		regions[land_mass_region[l]].mouths.push_back(mouths[c]);
+		regions[land_mass_region[l]].river_systems.push_back(c);
+	}
+
+	// grows all the river systems of a region, with its own random numbers (seeded by land mass)
+	auto growRegion = [&](RiverRegion & region)
+	{
+		std::mt19937 prng(tool::counterRandom(BASE_RIVER_RANDOM_SEED, (uint64_t)region.land_mass));
+		std::vector<RiverGrowingNode> nodes(region.mouths.begin(), region.mouths.end());// all growing nodes ever created, the frontier refers to them by index
+		nodes.reserve(region.mouths.size() * 32);
+		std::vector<RiverNode> & river_nodes = region.river_nodes;
+
+		std::vector<RiverGrowingNode> candidates;
+		candidates.reserve(16);
+		std::vector<RiverGrowingNode> branch_list;
+		branch_list.reserve(region.mouths.size() * 32);
+		std::vector<int> regrown;// nodes grown during a round, back in the frontier at the end of the round
+		regrown.reserve(region.mouths.size() * 32);
+		std::vector<RiverFrontierEntry> frontier;// binary max-heap of the growing nodes (springs excluded)
+		frontier.reserve(region.mouths.size() * 32);
+
+		for (int k = 0; k < (int)nodes.size(); ++k)
+		{
+			river_nodes.push_back({
+				nodes[k].base_vertex,
+				-1,
+				(int)river_nodes.size() + 1, -1,
+				nodes[k].edge, -1,
+				0.0f,
+				-1, 
+				-1.0f,
+				-1
+				, 0.0,
+				region.river_systems[k], //river_system_id
+				false
+				});
+
+			nodes[k].tip_river_node = (int)river_nodes.size();
+
+			river_nodes.push_back({
+				nodes[k].tip_vertex,
+				(int)river_nodes.size() - 1,
+				-1, -1,
+				-1, -1, 
+				0.0f,
+				-1,
+				-1.0f,
+				-1
+				, 0.0,
+				region.river_systems[k], //river_system_id
+				false
+				});
+		}
+
+		// -- grow rivers --	
+		// each round grows the MAX_NODES_TO_PROCESS nodes of highest priority, at most once each : the grown nodes and the new branches only come back into the frontier at the end of the round.
+		// springs never enter the frontier, and a node priority only changes when it grows, so that the heap holds no stale entry.
+		for (int i = 0; i < (int)nodes.size(); ++i)
+			if (!nodes[i].spring)
+				frontier.push_back(makeRiverFrontierEntry(nodes, i));
+		std::make_heap(frontier.begin(), frontier.end(), compareRiverFrontierEntry);
+
+		int MAX_NODES_TO_PROCESS = 8;
+		while (!frontier.empty())
+		{
+			int processed_nodes = 0;
+			while (processed_nodes < MAX_NODES_TO_PROCESS && !frontier.empty())//try to grow each node
+			{
+				std::pop_heap(frontier.begin(), frontier.end(), compareRiverFrontierEntry);
+				const int node_index = frontier.back().node;
+				frontier.pop_back();
+				const RiverGrowingNode & node = nodes[node_index];
+
+				const EdgeGPU & edge = m_base_edges[node.edge];
+				const int v = node.tip_vertex;
+				VertexGPU & V = m_base_vertices[v];
+				const math::dvec3 pv(m_base_vattrib[v].position);
+				const math::dvec3 edgevec = pv - math::dvec3(m_base_vattrib[edge.v0 == v ? edge.v1 : edge.v0].position);
+				const PlanetData::Data local_data = m_planet->getInterpolatedModelData(pv);
+
+				bool edgefound = false;
+				const int adjacency_begin = m_vertex_edge_offsets[v], adjacency_end = m_vertex_edge_offsets[v + 1];
+
+				candidates.clear();
+				RiverGrowingNode candidateNode;
+
+				for (int k = adjacency_begin; k < adjacency_end; ++k)
+				{
+					const int e = m_vertex_edges[k].edge;
+					const int w = m_vertex_edges[k].vertex;
+					if (!isTipEligible(w))
+						continue;// (also ensures that both faces of the edge are continent triangles)
+
+					const math::dvec3 edgevec2 = math::dvec3(m_base_vattrib[w].position) - pv;
+					const double dotEdges = dot(edgevec, edgevec2);
+					if (dotEdges < 0.2)
+						continue;//check angle of edges to make proper rivers
+
+					edgefound = true;
+					RiverGrowingNode candidate;
+					candidate.edge = e;
+					candidate.tip_vertex = w;
+					double penalty = 100.0;
+	#ifdef BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS
+					for (const MountainVertex & MV : mountains)
+					{
+						double distance = math::distance(math::dvec3(MV.position), math::dvec3(m_base_vattrib[w].position));
+						distance /= std::sqrt(MV.position.w);//the higher the mountain the more weight it has.
+						if (interest > distance)
+							interest = distance;
+					}
+	#endif
+					double r = (double)(prng() % 65536) / 65535.0;
+					penalty *= 0.1 + 0.38*r + std::abs(math::dot(local_data.strain_direction, math::normalize(edgevec2)));// favor river direction orthogonal to local tectonic folding direction
+					r = (double)(prng() % 65536) / 65535.0;
+					//penalty *= 0.38*r + (1.0 - dotEdges);//favor non sinuosity
+					penalty *= (0.05 + m_base_vattrib[w].misc2.y);//favor non-plateaux to grow river locally 
+					penalty *= 1.0 - 0.99*math::smoothstep(-0.2, 0.1, m_base_vattrib[w].data.z - m_base_vattrib[v].data.z);//favor going "up hill"
+					candidate.choice_penalty = penalty;
+					candidates.push_back(candidate);				
+				}
+
+				if (!edgefound)
+				{// cannot grow river: terminate it and make a local spring.
+					nodes[node_index].spring = true;
+					const double water_altitude = m_base_vattrib[v].position.w;
+					m_base_vattrib[v].data.w = water_altitude;
+					m_base_vattrib[v].flow.w = SPRING_FLOWVALUE;
+					makeRiverVertex(v);
+					continue;
+				}
+				
+				// sort candidates based on interest:
+				std::sort(candidates.begin(), candidates.end(), compareBaseRiverNode);
+				candidateNode = candidates[0];				
+			
+				bool branching = false;
+				RiverGrowingNode branch;
+			
+				const double proba_lerp = math::clamp(node.length_to_mouth / MAX_RIVER_LENGTH, 0.0, 1.0);
+				const int branching_proba = (int)math::mix(100.0, 0.0, std::sqrt(proba_lerp));
+
+				if (edgefound && prng() % 100 >= branching_proba && node.num_edges_to_mouth > 2.0)// sometimes make a branching river node (except for river mouth or so)
+				{
+					candidates.clear();
+
+					for (int k = adjacency_begin; k < adjacency_end; ++k)
+					{
+						const int e = m_vertex_edges[k].edge;
+						if (e == candidateNode.edge)
+							continue;
+
+						const int w = m_vertex_edges[k].vertex;
+						if (!isTipEligible(w))
+							continue;
+						const math::dvec3 edgevec2 = math::dvec3(m_base_vattrib[w].position) - pv;
+						if (dot(edgevec, edgevec2) < 0.0)
+							continue;//check angle of edges to make proper rivers
+
+						branching = true;
+						branch.edge = e;
+						branch.tip_vertex = w;
+						double penalty = 100.0;
+						double r = (double)(prng() % 65536) / 65535.0;
+						penalty *= 0.1 + 0.38*r + std::abs(math::dot(local_data.strain_direction, math::normalize(edgevec2)));// favor river direction orthogonal to local tectonic folding direction
+						r = (double)(prng() % 65536) / 65535.0;
+						//penalty *= 0.38*r + (1.0 - dotEdges);//favor non sinuosity
+						penalty *= (0.05 + m_base_vattrib[w].misc2.y);//favor non-plateaux to grow river locally 
+						penalty *= 1.0 - 0.99*math::smoothstep(-0.2, 0.1, m_base_vattrib[w].data.z - m_base_vattrib[v].data.z);//favor going "up hill"
+						branch.choice_penalty = penalty;
+
+						candidates.push_back(branch);					
+					}
+
+					std::sort(candidates.begin(), candidates.end(), compareBaseRiverNode);
+					branch = candidates[0];
+				}
+
+				double nl = node.num_edges_to_mouth + 1.0;
+				const double prev_altitude = m_base_vattrib[v].position.w;//altitude of the previous river vertex			
+				const float prev_riverprofile = m_base_vattrib[v].misc2.w;
+
+				double MAX_SPRING_ALTITUDE;
+				const double Margin = 0.07;// 70 m
+			
+				if (edgefound)
+				{
+					candidateNode.base_vertex = node.tip_vertex;
+					candidateNode.priority = node.priority;
+				
+					math::dvec4 va = m_base_vattrib[candidateNode.tip_vertex].position;
+
+					candidateNode.num_edges_to_mouth = nl;
+					candidateNode.spring = false;
+					candidateNode.length_to_mouth = node.length_to_mouth + math::distance(math::dvec3(va), pv);
+					candidateNode.normalized_tecto_altitude = (m_base_vattrib[candidateNode.tip_vertex].data.z - m_planet->seaLevelKm) / m_planet->maxAltitude;
+				
+					m_base_edges[candidateNode.edge].type = TYPE_RIVER;
+					makeRiverVertex(candidateNode.tip_vertex);
+				
+					const double max_altitude = va.w;		
+					double MAXALT = max_altitude - Margin;
+					if (MAXALT < m_planet->seaLevelKm + 0.008)
+						MAXALT = max_altitude;
+					MAX_SPRING_ALTITUDE = std::max(0.7, 0.5 * (MAXALT - m_planet->seaLevelKm)) + m_planet->seaLevelKm;
+					double r = (double)(prng() % 65536) / 65535.0;
+					double altitude = prev_altitude + std::max(0.0, r*r * (max_altitude - m_planet->seaLevelKm) * 0.02);//max 200 m
+					if (node.num_edges_to_mouth == 1.0)
+						altitude = m_planet->seaLevelKm;
+					altitude = std::max(altitude, m_planet->seaLevelKm - 0.02);
+				
+					math::dvec3 p;
+				
+					if (altitude < MAXALT && altitude < MAX_SPRING_ALTITUDE && candidateNode.length_to_mouth < MAX_RIVER_LENGTH)
+					{//only grow the river if conditions are met
+						p = math::dvec3(va);
+						p = math::normalize(p) * (m_planet->radiusKm + altitude);
+						const double water_altitude = altitude;
+						m_base_vattrib[candidateNode.tip_vertex].position = math::dvec4(p, altitude);										
+						m_base_vattrib[candidateNode.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);								
+					}
+					else // else make the river spring and terminate
+					{
+						altitude = std::max(prev_altitude, std::min(MAX_SPRING_ALTITUDE, MAXALT));
+						p = math::dvec3(va);
+						p = math::normalize(p) * (m_planet->radiusKm + altitude);
+						const double water_altitude = altitude;
+						m_base_vattrib[candidateNode.tip_vertex].position = math::dvec4(p, altitude);
+						m_base_vattrib[candidateNode.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);
+						candidateNode.spring = true;
+					}				
+					m_base_vattrib[candidateNode.tip_vertex].flow = math::vec4(math::vec3(math::normalize(pv - p)), 0.0f);
+					m_base_vattrib[candidateNode.tip_vertex].misc2.w = prev_riverprofile + 0.05f * (float)(prng() % 65536) / 65535.0f;//random offset from previous vertex for river profile
+					m_base_vattrib[candidateNode.tip_vertex].padding_and_debug.w = (float)(candidateNode.length_to_mouth / MAX_RIVER_LENGTH);
+				
+					candidateNode.tip_river_node = (int)river_nodes.size();
+					river_nodes[node.tip_river_node].nextnode1 = (int)river_nodes.size();
+					river_nodes[node.tip_river_node].nextedge1 = candidateNode.edge;
+					river_nodes.push_back({
+						candidateNode.tip_vertex,
+						node.tip_river_node,
+						-1, -1,
+						-1, -1, 
+						0.0f,
+						-1,
+						-1.0f,
+						-1,
+						candidateNode.length_to_mouth,
+						river_nodes[node.tip_river_node].river_system_id,
+						false
+					});
+
+					nodes[node_index] = candidateNode;
+				}
+
+				if (branching)
+				{
+					math::dvec4 va = m_base_vattrib[branch.tip_vertex].position;
+					V.branch_count = 1;
+
+					branch.base_vertex = node.tip_vertex;
+					branch.length_to_mouth = node.length_to_mouth + math::distance(math::dvec3(va), pv);
+					branch.priority = node.priority;
+				
+					branch.num_edges_to_mouth = nl;
+					branch.spring = false;
+					branch.normalized_tecto_altitude = (m_base_vattrib[branch.tip_vertex].data.z - m_planet->seaLevelKm) / m_planet->maxAltitude;
+					m_base_edges[branch.edge].type = TYPE_RIVER;
+					makeRiverVertex(branch.tip_vertex);
+								
+					const double max_altitude = va.w;
+					double MAXALT = max_altitude - Margin;
+					if (MAXALT < m_planet->seaLevelKm + 0.008)
+						MAXALT = max_altitude;
+					MAX_SPRING_ALTITUDE = std::max(0.7, 0.7 * (MAXALT - m_planet->seaLevelKm)) + m_planet->seaLevelKm;
+					double r = (double)(prng() % 65536) / 65535.0;
+					double altitude = prev_altitude + std::max(0.0, (1.0 - r) * (max_altitude - m_planet->seaLevelKm) * 0.02);//max 200m
+					if (node.num_edges_to_mouth == 1.0)
+						altitude = m_planet->seaLevelKm;
+					altitude = std::max(altitude, m_planet->seaLevelKm - 0.02);
+
+					math::dvec3 p;
+				
+					if (altitude < MAXALT && altitude < MAX_SPRING_ALTITUDE && branch.length_to_mouth < MAX_RIVER_LENGTH)
+					{//only grow the river if altitude stays below planet data
+						p = math::dvec3(va);
+						p = math::normalize(p) * (m_planet->radiusKm + altitude);
+						const double water_altitude = altitude;
+						m_base_vattrib[branch.tip_vertex].position = math::dvec4(p, altitude);
+						m_base_vattrib[branch.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);					
+					}
+					else // else make the river spring and terminate
+					{
+						altitude = std::max(prev_altitude, std::min(MAX_SPRING_ALTITUDE, MAXALT));
+						p = math::dvec3(va);
+						p = math::normalize(p) * (m_planet->radiusKm + altitude);
+						const double water_altitude = altitude;
+						m_base_vattrib[branch.tip_vertex].position = math::dvec4(p, altitude);
+						m_base_vattrib[branch.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);
+						branch.spring = true;
+					}
+					m_base_vattrib[branch.tip_vertex].flow = math::vec4(math::vec3(math::normalize(pv - p)), 0.0);
+					m_base_vattrib[branch.tip_vertex].misc2.w = prev_riverprofile + 0.05f * (float)(prng() % 65536) / 65535.0f;//random offset from previous vertex for river profile
+					m_base_vattrib[branch.tip_vertex].padding_and_debug.w = (float)(branch.length_to_mouth / MAX_RIVER_LENGTH);
+				
+					branch.tip_river_node = (int)river_nodes.size();
+					if (!branch.spring)
+					{					
+						branch_list.push_back(branch);
+					}
+
+					river_nodes[node.tip_river_node].nextnode2 = (int)river_nodes.size();
+					river_nodes[node.tip_river_node].nextedge2 = branch.edge;
+					river_nodes.push_back({
+						branch.tip_vertex,
+						node.tip_river_node,
+						-1, -1,
+						-1, -1, 
+						0.0f,
+						-1,
+						-1.0f,
+						-1,
+						branch.length_to_mouth,
+						river_nodes[node.tip_river_node].river_system_id,
+						false
+					});
+				}
+
+				if (!node.spring)
+					regrown.push_back(node_index);
+				processed_nodes++;
+			}
+
+			for (int i : regrown)
+			{
+				frontier.push_back(makeRiverFrontierEntry(nodes, i));
+				std::push_heap(frontier.begin(), frontier.end(), compareRiverFrontierEntry);
+			}
+			regrown.clear();
+
+			for (auto it = branch_list.begin(); it != branch_list.end(); ++it)
+			{
+				nodes.push_back(*it);//finally add all branch nodes to the frontier
+				frontier.push_back(makeRiverFrontierEntry(nodes, (int)nodes.size() - 1));
+				std::push_heap(frontier.begin(), frontier.end(), compareRiverFrontierEntry);
+			}
+			branch_list.clear();
+
+			MAX_NODES_TO_PROCESS = (int)std::max(8.0, (double)frontier.size() / 8.0);
+		}
+	};
+
+	// largest regions first, so that they do not end up alone on one thread at the end
+	std::vector<int> schedule(regions.size());
+	for (int r = 0; r < (int)regions.size(); ++r)
+		schedule[r] = r;
+	std::stable_sort(schedule.begin(), schedule.end(), [&](int A, int B) { return regions[A].mouths.size() > regions[B].mouths.size(); });
+	std::atomic<int> next_region(0);
+	auto region_worker = [&]()
+	{
+		for (int s = next_region.fetch_add(1); s < (int)schedule.size(); s = next_region.fetch_add(1))
+			growRegion(regions[schedule[s]]);
+	};
+	for (unsigned int t = 1; t < std::min(num_threads, (unsigned int)regions.size()); ++t)
+		threads.emplace_back(region_worker);
+	region_worker();
+	for (std::thread & thread : threads)
+		thread.join();
+
+	// -- merge the regions into m_river_nodes, in land mass order (the same whatever the number of threads) --
+	int num_river_nodes = 0;
+	for (const RiverRegion & region : regions)
+		num_river_nodes += (int)region.river_nodes.size();
+	m_river_nodes_max_size = std::max(num_river_nodes, num_vertices);
+	m_river_nodes = new RiverNode[m_river_nodes_max_size];
+	m_river_nodes_size = 0;
+	std::vector<int> river_mouth_nodes(mouths.size());
+	for (const RiverRegion & region : regions)
+	{
+		const int offset = m_river_nodes_size;
+		auto shift = [offset](int node) { return node == -1 ? -1 : node + offset; };
+		for (RiverNode n : region.river_nodes)
+		{
+			n.prevnode = shift(n.prevnode);
+			n.nextnode1 = shift(n.nextnode1);
+			n.nextnode2 = shift(n.nextnode2);
+			m_river_nodes[m_river_nodes_size++] = n;
+		}
+		for (int k = 0; k < (int)region.river_systems.size(); ++k)
+			river_mouth_nodes[region.river_systems[k]] = offset + 2 * k;
+	}
+	m_rivers.assign(river_mouth_nodes.begin(), river_mouth_nodes.end());
+	tool::recordStage(m_time_data.river_growth, stage, m_river_nodes_size);
+}
+
+/** Runs task(i) for each i in [0, count), on all hardware threads, one index at a time. */
+template <typename Task>
+static void parallelFor(int count, Task task)
+{
+	std::atomic<int> next(0);
+	auto worker = [&]()
+	{
+		for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+			task(i);
+	};
+	const unsigned int num_threads = std::min(std::max(1u, std::thread::hardware_concurrency()), (unsigned int)std::max(count, 1));
+	std::vector<std::thread> threads;
+	for (unsigned int t = 1; t < num_threads; ++t)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread & thread : threads)
+		thread.join();
+}
+
+static int computeHortonStralher(RiverForest & forest, int river_system, RiverNode * array)
+{//@returns the Hroton-Stralher number of the mouth of this river system
+
+	const int begin = forest.system_offsets[river_system], end = forest.system_offsets[river_system + 1];
+	for (int i = end - 1; i >= begin; --i)
+	{
+		const int HS1 = forest.child1[i] == -1 ? 0 : forest.horton_stralher[forest.child1[i]];
+		const int HS2 = forest.child2[i] == -1 ? 0 : forest.horton_stralher[forest.child2[i]];
+		RiverNode & n = array[forest.node[i]];
+
+		if (HS1 == 0)
+		{
+			n.horton_stralher = 1;
+		}
+		else 
+		{
+			if (HS2 == 0)
+			{
+				n.horton_stralher = HS1;
+			}
+			else if (HS1 == HS2)
+			{
+				n.horton_stralher = HS1 + 1;
+				n.asymetric_branching = false;
+			}
+			else
+			{
+				n.horton_stralher = HS1 > HS2 ? HS1 : HS2;
+				n.asymetric_branching = true;
+			}
+		}
+		forest.horton_stralher[i] = n.horton_stralher;
+	}
+	
+	return forest.horton_stralher[begin];
+}
+
+static void computeRiverFlow(RiverForest & forest, int river_system, RiverNode * array, float flow)
+{
+	const int begin = forest.system_offsets[river_system], end = forest.system_offsets[river_system + 1];
+	forest.flow[begin] = flow;
+	for (int i = begin; i < end; ++i)
+	{
+		if (!forest.flowing[i])
+			continue;
+		RiverNode & n = array[forest.node[i]];
+		const int c1 = forest.child1[i], c2 = forest.child2[i];
+
+		if (c1 == -1)
+			n.flow_value = SPRING_FLOWVALUE;
+		else 	
+		{
+			const float f = forest.flow[i];
+			n.flow_value = f;
+
+			if (c2 == -1)
+			{
+				forest.flow[c1] = f;
+			}
+			else
+			{
+				if (n.asymetric_branching)
+				{
+					float w1 = (float)forest.horton_stralher[c1];
+					float w2 = (float)forest.horton_stralher[c2];
+					forest.flow[c1] = f * w1 / (w1 + w2);
+					forest.flow[c2] = f * w2 / (w1 + w2);
+				}
+				else {
+					forest.flow[c1] = f * 0.5f;
+					forest.flow[c2] = f * 0.5f;
+				}
+			}
+		}
+	}
+}
+
+void PlanetBaseBuilder::layoutRiverForest(RiverForest & forest) const
+{
+	// river systems ranges (counting sort of the nodes by river system)
+	const int num_systems = (int)m_rivers.size();
+	forest.system_offsets.assign(num_systems + 1, 0);
+	for (int i = 0; i < m_river_nodes_size; ++i)
+		forest.system_offsets[m_river_nodes[i].river_system_id + 1]++;
+	for (int k = 0; k < num_systems; ++k)
+		forest.system_offsets[k + 1] += forest.system_offsets[k];
+
+	forest.node.resize(m_river_nodes_size);
+	forest.child1.resize(m_river_nodes_size);
+	forest.child2.resize(m_river_nodes_size);
+	forest.flowing.resize(m_river_nodes_size);
+	forest.horton_stralher.resize(m_river_nodes_size);
+	forest.flow.resize(m_river_nodes_size);
+	forest.river_length.resize(m_river_nodes_size);
+	forest.water_altitude.resize(m_river_nodes_size);
+
+	// pre-order of each river system, from its mouth (m_rivers is in river system order)
+	const std::vector<int> mouths(m_rivers.begin(), m_rivers.end());
+	parallelFor(num_systems, [&](int k)
+	{
+		struct Pending
+		{
+			int node;
+			int parent;// position of the parent, -1 for the mouth
+			bool first_child;
+		};
+		std::vector<Pending> stack;
+		stack.push_back({ mouths[k], -1, true });
+		int position = forest.system_offsets[k];
+		while (!stack.empty())
+		{
+			const Pending pending = stack.back();
+			stack.pop_back();
+			const RiverNode & n = m_river_nodes[pending.node];
+			forest.node[position] = pending.node;
+			forest.child1[position] = -1;
+			forest.child2[position] = -1;
+			forest.flowing[position] = 1;
+			if (pending.parent != -1)
+			{
+				(pending.first_child ? forest.child1 : forest.child2)[pending.parent] = position;
+				forest.flowing[position] = forest.flowing[pending.parent] && m_river_nodes[forest.node[pending.parent]].nextnode1 != -1;
+			}
+			if (n.nextnode2 != -1)
+				stack.push_back({ n.nextnode2, position, false });
+			if (n.nextnode1 != -1)
+				stack.push_back({ n.nextnode1, position, true });// popped first
+			position++;
+		}
+	});
+}
+
+void PlanetBaseBuilder::computeWaterElevations(RiverForest & forest, int river_system, double water_depth_at_mouth) const
+{
+	// the nextnode1 subtree of the mouth (the mouth itself, at the first position, keeps its elevation)
+	const int begin = forest.system_offsets[river_system];
+	const int end = forest.child2[begin] == -1 ? forest.system_offsets[river_system + 1] : forest.child2[begin];
+	for (int i = end - 1; i > begin; --i)
+	{
+		if (!forest.flowing[i])
+			continue;
+
+		const RiverNode & n = m_river_nodes[forest.node[i]];
+		const int c1 = forest.child1[i], c2 = forest.child2[i];
+		if (c1 == -1)//river spring:
+		{
+			forest.water_altitude[i] = m_base_vattrib[n.vertex].position.w;
+			forest.river_length[i] = n.length_to_mouth;//total river length
+			continue;
+		}
+
+		const double length1 = forest.river_length[c1];
+		const double length2 = c2 == -1 ? 0.0 : forest.river_length[c2];
+		const double riverlength = std::max(length1, length2);
+
+		double t = n.length_to_mouth / riverlength;
+		t *= t;
+		const double water_depth = water_depth_at_mouth * (1.0 - 0.9 * t * t);
+		forest.water_altitude[i] = m_base_vattrib[n.vertex].position.w + water_depth;
+
+		forest.river_length[i] = riverlength;
+	}
+}
+
+void PlanetBaseBuilder::postprocessBaseRiverNetwork()
+{
+	// --- river systems in pre-order (the recursive passes over the river nodes become sweeps, and the river systems are processed in parallel) ---
+	RiverForest forest;
+	layoutRiverForest(forest);
+	const int num_systems = (int)m_rivers.size();
+
+	// --- compute Horton-Stralher number ---
+	std::vector<int> system_hs(num_systems);
+	parallelFor(num_systems, [&](int k) { system_hs[k] = computeHortonStralher(forest, k, m_river_nodes); });
+	int max_hs = 0;	
+	for (int hs : system_hs)
+		if (hs > max_hs)
+			max_hs = hs;			
+		
+	double max_len = 0.0;
+	std::vector<double> maxriverlength(m_rivers.size(), 0.0);
+	for (int i=0; i < m_river_nodes_size; ++i)
+		if (m_river_nodes[i].nextnode1 == -1)
+		{
+			if (m_river_nodes[i].length_to_mouth > max_len)
+				max_len = m_river_nodes[i].length_to_mouth;
+
+			if (m_river_nodes[i].length_to_mouth > maxriverlength[m_river_nodes[i].river_system_id])
+				maxriverlength[m_river_nodes[i].river_system_id] = m_river_nodes[i].length_to_mouth;
+		}
+	std::cout << "Max river length = " << max_len << " km" << std::endl;
+
+	// --- prune un-grown river nodes ---
+	std::mt19937 prng;
+
+	const double river_length_threshold = 10.0;//km
+	for (int i = 0; i < m_river_nodes_size; ++i)
+	{
+		RiverNode & n = m_river_nodes[i];
+		if (maxriverlength[n.river_system_id] > river_length_threshold)
+		{
+			prng.seed(n.river_system_id * 33875999);
+			float river_id = (float)(prng() % 65536);
+			m_base_vattrib[n.vertex].padding_and_debug.w = river_id;
+			continue;
+		}
+
+		n.disabled = true;
+
+		m_base_vertices[n.vertex].type = TYPE_CONTINENT;
+		VertexAttributesGPU & attrib = m_base_vattrib[n.vertex];
+		math::dvec3 pos = math::normalize(math::dvec3(attrib.position));
+		attrib.position = math::dvec4((attrib.data.z + m_planet->radiusKm) * pos, attrib.data.z);
+		attrib.data = math::dvec4(attrib.data.z, 50.0, attrib.data.z, m_planet->seaLevelKm);
+
+		if (n.nextedge1 != -1)
+			m_base_edges[n.nextedge1].type = TYPE_NONE;
+		if (n.nextedge2 != -1)
+			m_base_edges[n.nextedge2].type = TYPE_NONE;
+	}
+	
+	// Compute river flow, output Horton-Strahler data:
+	float avg_hs = 0.0f;
+	float final_num_rivers = 0.0f;
+	for (auto it = m_rivers.begin(); it != m_rivers.end(); ++it)
+	{
+		int mouth = *it;
+
+		if (m_river_nodes[mouth].disabled)
+			continue;
+		final_num_rivers += 1.0f;
+
+		int hs = m_river_nodes[mouth].horton_stralher;
+		avg_hs += (float)hs;
+	}
+	parallelFor(num_systems, [&](int k)
+	{
+		const int mouth = forest.node[forest.system_offsets[k]];
+		if (m_river_nodes[mouth].disabled)
+			return;
+		float flow = std::sqrt(maxriverlength[k] / max_len);
+		computeRiverFlow(forest, k, m_river_nodes, flow);
+	});
+	avg_hs /= final_num_rivers;
+	std::cout << "Final river systems count = " << (int)final_num_rivers << " (out of total " << m_rivers.size() << " candidate systems)." << std::endl;
+	std::cout << "Horton-Strahler: max " << max_hs << ", average " << avg_hs << "." << std::endl;
+
+	for (int i = 0; i < m_river_nodes_size; ++i)
+	{
+		RiverNode & n = m_river_nodes[i];
+		if (n.disabled)
+			continue;
+
+		if (m_base_vertices[n.vertex].type == TYPE_RIVER)
+			m_base_vattrib[n.vertex].flow.w = n.flow_value;
+	}
+
+	// Assign water elevations:
+	parallelFor(num_systems, [&](int k)
+	{
+		const int mouth = forest.node[forest.system_offsets[k]];
+		if (m_river_nodes[mouth].disabled)
+			return;
+
+		int nextmouth = m_river_nodes[mouth].nextnode1;
+				
+		const double water_depth = m_planet->seaLevelKm - m_base_vattrib[m_river_nodes[nextmouth].vertex].position.w;
+
+		computeWaterElevations(forest, k, water_depth);
+	});
+	// river systems can share vertices : written serially, in river system order
+	for (int k = 0; k < num_systems; ++k)
+	{
+		if (m_river_nodes[forest.node[forest.system_offsets[k]]].disabled)
+			continue;
+		const int begin = forest.system_offsets[k];
+		const int end = forest.child2[begin] == -1 ? forest.system_offsets[k + 1] : forest.child2[begin];
+		for (int i = end - 1; i > begin; --i)
+			if (forest.flowing[i])
+				m_base_vattrib[m_river_nodes[forest.node[i]].vertex].data.w = forest.water_altitude[i];
+	}
+}
+
+void PlanetBaseBuilder::buildVertexEdges()
+{
+	// counting sort of the edge endpoints by vertex : the edges of each vertex come out by increasing index
+	const int num_vertices = (int)m_base_vertices.size();
+	m_vertex_edge_offsets.assign(num_vertices + 1, 0);
+	for (const EdgeGPU & E : m_base_edges)
+	{
+		m_vertex_edge_offsets[E.v0 + 1]++;
+		m_vertex_edge_offsets[E.v1 + 1]++;
+	}
+	for (int v = 0; v < num_vertices; ++v)
+		m_vertex_edge_offsets[v + 1] += m_vertex_edge_offsets[v];
+
+	m_vertex_edges.resize(2 * m_base_edges.size());
+	std::vector<int> cursor(m_vertex_edge_offsets.begin(), m_vertex_edge_offsets.end() - 1);
+	for (int e = 0; e < (int)m_base_edges.size(); ++e)
+	{
+		const EdgeGPU & E = m_base_edges[e];
+		m_vertex_edges[cursor[E.v0]++] = { e, E.v1 };
+		m_vertex_edges[cursor[E.v1]++] = { e, E.v0 };
+	}
+}
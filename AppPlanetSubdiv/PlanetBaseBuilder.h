@@ -0,0 +1,325 @@
+#pragma once
+
+#include "PlanetData.h"
+#include "SphericalDelaunay.h"
+#include "tool.h"
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+
+// ---- options ----
+//#define BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS				// if defined then lookup tectonic max elevations for growing the base river network (this is very costly!)
+#define BASE_MESH_HILBERT_ORDER								// if defined then the base mesh vertices are sorted along a Hilbert curve, and the edges and triangles by first vertex (memory locality of the river growth and of the GPU subdivision)
+
+#define TYPE_NONE							0	
+#define TYPE_SEA							1		
+#define TYPE_CONTINENT						2
+#define TYPE_RIVER							3
+#define TYPE_COAST							4
+#define TYPE_RIDGE							5
+#define TYPE_OCTAHEDRON_EDGE				16
+
+#define BASE_VERTEX_RANDOM_SEED				13337		// seed of the per-vertex random numbers (elevation jitter, GPU PRNG seeds), drawn from the vertex index
+#define BASE_VERTEX_SAMPLING_BLOCK_SIZE		1024		// number of vertices handed to a thread at once when sampling the planet data
+#define BASE_RIVER_RANDOM_SEED				5489		// seed of the river growth random numbers, combined with the land mass index (each land mass grows with its own generator)
+#define RIVER_TIP_MASK_BLOCK_SIZE			4096		// number of vertices (a multiple of 64) handed to a thread at once when computing the river tip eligibility mask
+
+#define PLANET_BAKE_FILE_VERSION			3			// version of the baked planet files (see PlanetBakeFileHeader), to bump whenever the builder output changes
+#define PLANET_BAKE_FILE_SECTION_ALIGNMENT	64			// byte alignment of the sections of the baked planet files
+
+#define SEA_MIN_WATER_BODY_SIZE				9			// water bodies (connected sea vertices) smaller than this are puddles, not sea, for the river mouths
+
+#define SPRING_FLOWVALUE					0.01f		// value of the flow at spring locations (slightly above zero)
+
+#define ADAPTIVE_DENSITY_SHELF_DEPTH_KM		0.2			// (adaptive density) seas shallower than this, ie. coasts and continental shelves, keep the minimum edge length
+#define ADAPTIVE_DENSITY_OCEAN_DEPTH_KM		2.0			// (adaptive density) open ocean deeper than this gets the maximum edge length, unless strained (ridges, trenches)
+
+
+struct alignas(16) EdgeGPU
+{
+	/// indexes of the two vertices
+	int v0, v1;
+	/// index of the middle split vertex
+	int vm = -1;
+	/// LSB to MSB: first byte = split status (0: not split, 1: ghost split, 2: split), second byte = boolean (ghost edge or not), third byte = subdivision level
+	unsigned int status = 0;
+	/// indexes of the two subedges if split
+	int child0 = -1, child1 = -1;	
+	/// indexes of the two adjacent faces
+	int f0, f1;
+	/// Type
+	unsigned int type = TYPE_NONE;
+	
+	int padding[3];
+};
+
+struct alignas(16) VertexGPU
+{
+	/// first list of indexes of incident faces (or -1 if none)
+	int faces_0[4] = { -1, -1, -1, -1 };
+	/// second list of indexes of incident faces (or -1 if none)
+	int faces_1[4] = { -1, -1, -1, -1 };
+	/// PRNG seed
+	unsigned int seed;
+	/// boolean = ghost or not ghost vertex
+	unsigned int status = 0;
+	/// Type : 0 none, 1 sea, 2 continent, 3 river
+	unsigned int type = TYPE_NONE;
+	/// number of river branches at that vertex (0 or 1) not counting the main river flow, ie., this is the number of tributaries at that vertex.
+	unsigned int branch_count = 0;
+	
+	/// some references (prim0 is used as a containing triangle index, for water animation ; prim1 is unused ; prim2 is a vertex reference used for lakes]
+	int prim0 = -1, prim1 = -1, prim2 = -1;
+	int padding1;
+
+	//math::ivec4 padding2;
+};
+
+struct alignas(16) TriangleGPU
+{
+	/// indexes of the three edges (they appear in the right winding order (RH rule)).
+	int e0, e1, e2;
+	/// normal to the triangle
+	float normal_x, normal_y, normal_z;
+	/// LSB to MSB : byte 0 = boolean (split 1 or not 0), byte 2 = lod
+	unsigned int status = 0;
+	/// Type
+	unsigned int type = TYPE_NONE;
+};
+
+struct alignas(32) VertexAttributesGPU
+{
+	/// xyz = 3D position, w = ground altitude
+	math::dvec4 position;
+	/// x = nearest river altitude, y = distance to nearest river, z = tectonic altitude (=max altitude), w = water altitude // - note we need double precision for water altitudes essentially.
+	math::dvec4 data;
+	/// xyz = water flow direction normalized, w = normalized flow quantity
+	math::vec4 flow;	
+	/// x = nearest ravin altitude, y = distance to nearest ravin, z = hilly landscape [0, 1], w = ravin flow value in [0, 1] (unused for now)
+	math::vec4 misc1;
+	/// x = crust age in Ma, y = plateau presence in [0, 1], z = desert/wet biome (1 is desert,0 is wet), w = river profile indirection
+	math::vec4 misc2;
+	//
+	math::vec4 padding_and_debug;
+};
+
+/// internal use only
+struct RiverGrowingNode
+{
+	double num_edges_to_mouth;
+	//double branching_level = 0.0;
+	double length_to_mouth = 0.0;
+	double target_river_length;//desired river length (max length)	
+	double choice_penalty;
+	double normalized_tecto_altitude;
+	double priority;
+	float max_flow_value;//unused ?
+	int edge;
+	int base_vertex;
+	int tip_river_node;
+	int tip_vertex;
+	bool spring;
+	bool full_grown;//unused ?
+};
+
+/// internal use only : an edge incident to a base vertex, and the opposite vertex of that edge
+struct BaseVertexEdge
+{
+	int edge;
+	int vertex;
+};
+
+struct RiverNode
+{
+	int vertex = -1;
+	int prevnode = -1;
+	int nextnode1 = -1;
+	int nextnode2 = -1;
+	int nextedge1 = -1;
+	int nextedge2 = -1;
+	float flow_value = 0.0f;
+	int horton_stralher = -1;
+	float rosgen_type = -1.0f;	
+	int asymetric_branching = -1;	
+	double length_to_mouth = 0.0;
+	int river_system_id = -1;//the river system this nodes belongs to
+	bool disabled = false;//true if this river node belongs to a river system that has been discarded.
+	char padding[3] = { 0, 0, 0 };//explicit padding, so that the baked planet files have no undefined bytes
+};
+
+/**
+ * internal use only : the river systems laid out in pre-order (each node, then its nextnode1 subtree, then its nextnode2 subtree), in struct of arrays form.
+ * Within the range of a river system, a reverse sweep visits children before parents (post-order passes) and a forward sweep parents before children.
+ */
+struct RiverForest
+{
+	std::vector<int> system_offsets;// the river system k is at positions system_offsets[k] (its mouth) to system_offsets[k + 1] - 1
+	std::vector<int> node;// river node at each position
+	std::vector<int> child1, child2;// positions of the nextnode1 and nextnode2 subtrees, -1 if none
+	std::vector<char> flowing;// 0 for the nextnode2 subtrees of nodes without nextnode1 : no flow and no water there
+	std::vector<int> horton_stralher;
+	std::vector<float> flow;
+	std::vector<double> river_length;// length of the longest river upstream
+	std::vector<double> water_altitude;
+};
+
+
+/**
+ * Header of the baked planet files written by PlanetBaseBuilder (see setBakeCache).
+ * It is followed by the edge, vertex, triangle, vertex attribute, river node and river mouth arrays, as laid out in memory and aligned on PLANET_BAKE_FILE_SECTION_ALIGNMENT bytes.
+ */
+struct PlanetBakeFileHeader
+{
+	char magic[4];/// "PBK" + '\0'
+	uint32_t version;/// PLANET_BAKE_FILE_VERSION
+	uint32_t endianness;/// 0x01020304, as written by the host
+	uint32_t header_size;/// sizeof(PlanetBakeFileHeader)
+	uint32_t edge_size, vertex_size, triangle_size, vattrib_size, river_node_size;/// sizeof of the array elements
+	uint32_t num_edges, num_vertices, num_triangles, num_river_nodes, num_rivers;
+	uint64_t key;/// hash of the inputs of the build (see PlanetBaseBuilder::getBakeKey)
+	uint64_t section_offset[6];/// byte offsets of the edge, vertex, triangle, vertex attribute, river node and river mouth arrays
+	uint64_t file_size;
+	uint64_t checksum;/// tool::checksum64 of the checksums of the six arrays
+};
+
+
+/// Statistics (wall-clock time, processed items, peak resident memory) of each stage of the base planet construction.
+struct PlanetBaseTimeData
+{
+	tool::StageStats bake_cache_load;/// items = vertices (replaces all the other stages when the baked planet is cached)
+	tool::StageStats delaunay_cache_load;/// items = vertices (replaces the sampling and triangulation stages when the base mesh triangulation is cached)
+	tool::StageStats poisson_sampling;/// items = samples
+	tool::StageStats delaunay_naive_lawson;/// items = naively inserted samples (SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION only)
+	tool::StageStats delaunay_insertion;/// items = inserted samples (the whole convex hull construction, or the incremental insertion after the Lawson pass)
+	tool::StageStats edge_build;/// items = edges
+	tool::StageStats vertex_sampling;/// items = vertices
+	tool::StageStats mesh_reorder;/// items = vertices (see BASE_MESH_HILBERT_ORDER)
+	tool::StageStats river_mouths;/// items = river mouths
+	tool::StageStats river_growth;/// items = river nodes
+	tool::StageStats river_postprocess;/// items = river nodes
+
+	double base_mesh_secs = 0.0;
+	double river_network_secs = 0.0;
+	double total_secs = 0.0;
+};
+
+
+/**
+ * @brief Builds the base planet on the CPU: Poisson-Delaunay base mesh, base river network and its post-process.
+ * This class has no dependency on OpenGL (and none on Qt either when compiled with PLANET_HEADLESS), so that base planets can be baked on machines without display or GPU.
+ * The resulting arrays are laid out exactly as the GPU subdivision expects them.
+ */
+class PlanetBaseBuilder
+{
+public:
+
+	/**
+	 * @param planet The planet data (elevations, continents, biomes...) to build upon.
+	 * @param min_edge_length_km Poisson radius of the base mesh sampling, ie. the minimum edge length of the base mesh.
+	 */
+	explicit PlanetBaseBuilder(const PlanetData * planet, double min_edge_length_km = 40.0) : m_planet(planet), MINIMUM_EDGE_LENGTH_KM(min_edge_length_km) {}
+	~PlanetBaseBuilder() { release(); }
+
+	PlanetBaseBuilder(const PlanetBaseBuilder &) = delete;
+	PlanetBaseBuilder & operator=(const PlanetBaseBuilder &) = delete;
+
+	/** Runs all stages in order (base mesh, river network, river post-process) and records their wall-clock time. */
+	void build();
+	void release();
+
+	void makePoissonDelaunayBaseMesh();
+	void createBaseRiverNetwork();
+	void postprocessBaseRiverNetwork();
+
+	inline std::vector<EdgeGPU> & getEdges() { return m_base_edges; }
+	inline std::vector<VertexGPU> & getVertices() { return m_base_vertices; }
+	inline std::vector<TriangleGPU> & getTriangles() { return m_base_triangles; }
+	inline std::vector<VertexAttributesGPU> & getVertexAttributes() { return m_base_vattrib; }
+
+	inline const RiverNode * getRiverNodes() const { return m_river_nodes; }
+	inline int getNumRiverNodes() const { return m_river_nodes_size; }
+	inline const std::list<int> & getRivers() const { return m_rivers; }
+
+	/**
+	 * Enables variable density sampling of the base mesh : land, coasts and strained areas keep the minimum edge length while the edge length grows up to max_edge_length_km in open ocean.
+	 * A value not above the minimum edge length disables it (uniform sampling, the default).
+	 */
+	inline void setAdaptiveDensity(double max_edge_length_km) { m_max_edge_length_km = max_edge_length_km; }
+
+	/** Sampling of the base mesh : Poisson disk (default) or jittered lattice, much faster to build and meant for preview planets (no adaptive density). */
+	inline void setSamplingMethod(SphereSamplingMethod method) { m_sampling_method = method; }
+
+	/**
+	 * Enables reuse of the base mesh triangulation across runs : it is loaded from (or else saved to) a .sdt file of this directory, named after the planet radius and the sampling parameters.
+	 * An empty directory disables it (the default). Adaptive density triangulations are never cached.
+	 */
+	inline void setTriangulationCache(const std::string & directory) { m_sdt_cache_directory = directory; }
+
+	/**
+	 * Enables reuse of the whole base planet (base mesh and river network) across runs : build() loads it from (or else saves it to) a .pbk file of this directory,
+	 * named after a hash of the planet input files, of the sampling parameters and of the seeds. An empty directory disables it (the default).
+	 */
+	inline void setBakeCache(const std::string & directory) { m_bake_cache_directory = directory; }
+
+	inline double getMinimumEdgeLength() const { return MINIMUM_EDGE_LENGTH_KM; }
+	inline double getMaximumEdgeLength() const { return std::max(MINIMUM_EDGE_LENGTH_KM, m_max_edge_length_km); }
+	inline const PlanetBaseTimeData & getTimeData() const { return m_time_data; }
+
+private:
+
+	/** @returns The .sdt file caching the triangulation of the base mesh, or an empty string if it is not cached. */
+	std::string getTriangulationCacheFile() const;
+	/** @returns A hash of everything the build depends on : planet input files and parameters, sampling parameters, seeds and builder options. */
+	uint64_t getBakeKey() const;
+	/** @returns The .pbk file caching the whole base planet, or an empty string if it is not cached. */
+	std::string getBakeCacheFile() const;
+	bool loadFromBakeFile(const std::string & filename);
+	bool persistToBakeFile(const std::string & filename) const;
+	/** @returns The poisson radius of the base mesh sampling at p (adaptive density). */
+	double getLocalSamplingRadius(const math::dvec3 & p) const;
+
+	void createAllRiverMouth(std::vector<RiverGrowingNode> & nodes);
+	/** Labels the connected components of TYPE_SEA vertices (m_water_body, m_water_body_size), with a union-find over the base edges. */
+	void labelWaterBodies();
+	/** @returns true if the water bodies adjacent to the triangle vertices make a sea, not a puddle (see SEA_MIN_WATER_BODY_SIZE). */
+	bool isTriangleSeaCoast(int triangle_index) const;
+	/** Builds the CSR vertex to edges adjacency of the base mesh (m_vertex_edge_offsets, m_vertex_edges), each vertex edges by increasing edge index. */
+	void buildVertexEdges();
+	/** Sorts the base mesh vertices along a Hilbert curve, then the edges and triangles by their first vertex, and remaps all indices accordingly. */
+	void reorderBaseMesh();
+
+	/** Lays out the river systems in m_river_nodes as a RiverForest (without recursion : river systems can be thousands of nodes deep). */
+	void layoutRiverForest(RiverForest & forest) const;
+	void computeWaterElevations(RiverForest & forest, int river_system, double water_depth_at_mouth) const;
+
+private:
+
+	const PlanetData * m_planet = nullptr;
+
+	std::vector<EdgeGPU> m_base_edges;
+	std::vector<VertexGPU> m_base_vertices;
+	std::vector<TriangleGPU> m_base_triangles;
+	std::vector<VertexAttributesGPU> m_base_vattrib;
+
+	std::vector<int> m_vertex_edge_offsets;// the edges incident to vertex v are m_vertex_edges[m_vertex_edge_offsets[v]] to m_vertex_edges[m_vertex_edge_offsets[v + 1] - 1]
+	std::vector<BaseVertexEdge> m_vertex_edges;
+
+	std::vector<int> m_water_body;// water body of each vertex, -1 if not a sea vertex
+	std::vector<int> m_water_body_size;// number of vertices of each water body
+
+	RiverNode * m_river_nodes = nullptr;//storage for all river nodes
+	std::list<int> m_rivers;//indexes of the river mouthes into m_river_nodes
+	int m_river_nodes_size = 0, m_river_nodes_max_size = 0;
+
+	const double MINIMUM_EDGE_LENGTH_KM;
+	double m_max_edge_length_km = 0.0;
+	SphereSamplingMethod m_sampling_method = SphereSamplingMethod::POISSON;
+	std::string m_sdt_cache_directory;
+	std::string m_bake_cache_directory;
+	double MAX_RIVER_LENGTH;
+
+	PlanetBaseTimeData m_time_data;
+};
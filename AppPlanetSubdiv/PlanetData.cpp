@@ -6,6 +6,15 @@
 
 
 
+/** @returns The checksum of the whole content of a file, 0 if it can not be read. */
+static uint64_t checksumFile(const std::string & filename)
+{
+	tool::MappedFile file;
+	if (!file.open(filename))
+		return 0;
+	return tool::checksum64(file.data(), file.size());
+}
+
 bool PlanetData::loadFromTectonicFile(const std::string & filename)
 {
 	// read data from disk:
@@ -36,6 +45,7 @@ bool PlanetData::loadFromTectonicFile(const std::string & filename)
 		file.read((char*)(m_triangles + i), sizeof(PersistentTectonicTriangle));
 
 	file.close();
+	m_input_hash = checksumFile(filename);
 
 	// create BVH:
 	std::vector<tool::Triangle> tris;
@@ -110,6 +120,9 @@ bool PlanetData::loadFromMaps(const std::string & path)
 
 	std::fclose(header);
 
+	const uint64_t hashes[4] = { checksumFile(headerfile), checksumFile(path + continents_mapname), checksumFile(path + elevations_mapname), checksumFile(path + humidity_mapname) };
+	m_input_hash = tool::checksum64(hashes, sizeof(hashes));
+
 	return true;
 }
 
@@ -275,9 +288,67 @@ QRgb ProjectedMap::sample(const math::dvec3 & spherepos, double LongitudeManualO
 
 bool ProjectedMap::load(const std::string & filename)
 {
+#ifndef PLANET_HEADLESS
 	if (!m_img.load(QString(filename.c_str())))
 		return false;
+#else
+	if (!m_img.load(filename))
+	{
+		std::cout << "ERROR - ProjectedMap:: headless builds only read binary .pgm/.ppm maps, failed loading " << filename << std::endl;
+		return false;
+	}
+#endif
 
 	m_img_loaded = true;
 	return true;
 }
+
+
+#ifdef PLANET_HEADLESS
+bool NetpbmImage::load(const std::string & filename)
+{
+	std::ifstream file(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (!file.good())
+		return false;
+
+	std::string magic;
+	file >> magic;
+	if (magic != "P5" && magic != "P6")
+		return false;
+	const int channels = (magic == "P6") ? 3 : 1;
+
+	// header fields (width, height, maxval) may be interleaved with comment lines
+	int fields[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		file >> std::ws;
+		while (file.peek() == '#')
+		{
+			file.ignore(4096, '\n');
+			file >> std::ws;
+		}
+		file >> fields[i];
+	}
+	file.get();// single whitespace before the raster
+	if (!file.good() || fields[0] <= 0 || fields[1] <= 0 || fields[2] <= 0 || fields[2] > 255)
+		return false;
+
+	m_width = fields[0];
+	m_height = fields[1];
+	std::vector<unsigned char> raster((size_t)m_width * m_height * channels);
+	file.read((char*)raster.data(), raster.size());
+	if (file.gcount() != (std::streamsize)raster.size())
+		return false;
+
+	m_pixels.resize((size_t)m_width * m_height);
+	for (size_t i = 0; i < m_pixels.size(); ++i)
+	{
+		const unsigned char * c = raster.data() + i * channels;
+		const QRgb r = c[0];
+		const QRgb g = channels == 3 ? c[1] : c[0];
+		const QRgb b = channels == 3 ? c[2] : c[0];
+		m_pixels[i] = 0xff000000u | (r << 16) | (g << 8) | b;
+	}
+	return true;
+}
+#endif
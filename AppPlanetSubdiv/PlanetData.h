@@ -2,11 +2,35 @@
 
 #include "tool.h"
 
+#ifndef PLANET_HEADLESS
 #include <qimage.h>
+#endif
 
 #include <string>
 
 
+#ifdef PLANET_HEADLESS
+// Without Qt, maps are read from binary Netpbm files (P5 greyscale or P6 rgb) and exposed with the same accessors as QImage.
+typedef unsigned int QRgb;
+inline int qRed(QRgb rgb) { return (rgb >> 16) & 0xff; }
+inline int qGreen(QRgb rgb) { return (rgb >> 8) & 0xff; }
+inline int qBlue(QRgb rgb) { return rgb & 0xff; }
+
+class NetpbmImage
+{
+public:
+	bool load(const std::string & filename);
+	inline int width() const { return m_width; }
+	inline int height() const { return m_height; }
+	inline QRgb pixel(int x, int y) const { return m_pixels[y * m_width + x]; }
+
+private:
+	std::vector<QRgb> m_pixels;
+	int m_width = 0, m_height = 0;
+};
+#endif
+
+
 
 
 class ProjectedMap
@@ -28,7 +52,11 @@ public:
 	
 private:
 
+#ifndef PLANET_HEADLESS
 	QImage m_img;
+#else
+	NetpbmImage m_img;
+#endif
 	Projection m_projection = Projection::NONE;
 	bool m_img_loaded = false;
 };
@@ -88,6 +116,9 @@ struct PlanetData
 		double age;
 	};
 
+	/** @returns A hash of the loaded input files (tectonic file, or maps and their header), 0 if nothing was loaded. Identifies the planet in the baked planet cache (see PlanetBaseBuilder::setBakeCache). */
+	inline uint64_t getInputHash() const { return m_input_hash; }
+
 	PlanetData::Data getInterpolatedModelData(const math::dvec3 & surface_coordinates) const;
 	float getPlateauxDistribution(const math::dvec3 & position) const;
 	float getDesertDistribution(const math::dvec3 & position) const;
@@ -105,6 +136,7 @@ private:
 	PersistentTectonicTriangle * m_triangles = nullptr;
 	tool::BVH * m_bvh = nullptr;
 	int m_num_vertices = 0, m_num_triangles = 0;
+	uint64_t m_input_hash = 0;
 
 	ProjectedMap m_map_continent, m_map_elevation, m_map_humidity, m_map_age;
 
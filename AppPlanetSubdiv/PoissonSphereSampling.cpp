@@ -1,94 +1,311 @@
 #include "PoissonSphereSampling.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <thread>
 
 
 
+static const uint64_t EMPTY_BRICK_KEY = ~0ull;
+
+/**
+ * @brief Sparse acceleration grid for the Poisson sampling of a sphere surface.
+ * The cells are those of a regular grid over the bounding cube of the sphere, grouped in bricks of 4x4x4 cells. Only the bricks crossed
+ * by the sphere surface are allocated (either lazily, when a first sample is stored into them, or all at once with allocateShell) and are found back through an open addressing hash table.
+ * Memory thus scales with the area of the sphere instead of its volume, and the 27-cell neighborhood queries mostly hit a single brick.
+ * Once all bricks are allocated, several threads can concurrently read and write cells (as long as they do not write the same cells).
+ */
+class SphereShellGrid
+{
+public:
+
+	static const int BRICK_SHIFT = 2;
+	static const int BRICK_SIZE = 1 << BRICK_SHIFT;
+	static const int BRICK_CELLS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+	/// Per-thread cache of the last brick found (neighborhood queries are very coherent).
+	struct Cursor
+	{
+		uint64_t key = EMPTY_BRICK_KEY;
+		int offset = -1;
+	};
+
+	SphereShellGrid(int grid_size, size_t expected_samples) : m_grid_size(grid_size), m_bricks_per_axis((grid_size + BRICK_SIZE - 1) / BRICK_SIZE)
+	{
+		// the sphere surface crosses about one brick for every 3 samples
+		const size_t expected_bricks = expected_samples / 3;
+		size_t capacity = 1024;
+		while (capacity < 2 * expected_bricks)
+			capacity *= 2;
+		m_keys.assign(capacity, EMPTY_BRICK_KEY);
+		m_offsets.resize(capacity);
+		m_mask = capacity - 1;
+		m_cells.reserve(BRICK_CELLS * expected_bricks);
+	}
+
+	/**
+	 * Allocates all the bricks crossed by a sphere centered in the middle of the grid.
+	 * @param[out] bricks Coordinates of the allocated bricks, in a deterministic order.
+	 */
+	void allocateShell(double sphere_radius, double cell_size, std::vector<math::ivec3> & bricks)
+	{
+		const double brick_size = BRICK_SIZE * cell_size;
+		const double origin = -(m_grid_size / 2) * cell_size;
+		const double margin = 0.01 * cell_size;// robustness to rounding of the normalized samples
+		const double r_min = sphere_radius - margin;
+		const double r_max = sphere_radius + margin;
+		for (int by = 0; by < m_bricks_per_axis; ++by)
+		{
+			const double y0 = origin + by * brick_size, y1 = y0 + brick_size;
+			const double ny = (y0 > 0.0) ? y0 : ((y1 < 0.0) ? y1 : 0.0);
+			const double fy = std::max(std::abs(y0), std::abs(y1));
+			for (int bx = 0; bx < m_bricks_per_axis; ++bx)
+			{
+				const double x0 = origin + bx * brick_size, x1 = x0 + brick_size;
+				const double nx = (x0 > 0.0) ? x0 : ((x1 < 0.0) ? x1 : 0.0);
+				const double fx = std::max(std::abs(x0), std::abs(x1));
+				const double near2 = nx * nx + ny * ny;// squared distance from the z axis to the closest point of the column
+				const double far2 = fx * fx + fy * fy;// squared distance from the z axis to the farthest point of the column
+				if (near2 > r_max * r_max)
+					continue;
+				// the shell crosses the column for |z| in [z_min, z_max]
+				const double z_min = far2 < r_min * r_min ? std::sqrt(r_min * r_min - far2) : 0.0;
+				const double z_max = std::sqrt(r_max * r_max - near2);
+				for (int bz = 0; bz < m_bricks_per_axis; ++bz)
+				{
+					const double z0 = origin + bz * brick_size, z1 = z0 + brick_size;
+					const double nz = (z0 > 0.0) ? z0 : ((z1 < 0.0) ? z1 : 0.0);
+					const double fz = std::max(std::abs(z0), std::abs(z1));
+					if (std::abs(nz) > z_max || fz < z_min)
+						continue;
+					const int x = bx << BRICK_SHIFT, y = by << BRICK_SHIFT, z = bz << BRICK_SHIFT;
+					const uint64_t key = brickKey(x, y, z);
+					if (2 * (m_num_bricks + 1) > m_keys.size())
+						grow();
+					insertBrick(key, (int)m_cells.size());
+					m_cells.resize(m_cells.size() + BRICK_CELLS, -1);
+					bricks.push_back(math::ivec3(bx, by, bz));
+				}
+			}
+		}
+	}
+
+	/** @returns The value stored in the cell (a sample index), or -1 if the cell is empty (or out of the grid, or in a brick that is not allocated). */
+	inline int find(int x, int y, int z, Cursor & cursor) const
+	{
+		if (x < 0 || x >= m_grid_size || y < 0 || y >= m_grid_size || z < 0 || z >= m_grid_size)
+			return -1;
+		const int offset = findBrick(brickKey(x, y, z), cursor);
+		if (offset < 0)
+			return -1;
+		return m_cells[offset + cellInBrick(x, y, z)];
+	}
+
+	/** @returns A pointer to the cell, or nullptr if the cell lies in a brick that is not allocated. */
+	inline int * getCell(int x, int y, int z, Cursor & cursor)
+	{
+		if (x < 0 || x >= m_grid_size || y < 0 || y >= m_grid_size || z < 0 || z >= m_grid_size)
+			return nullptr;
+		const int offset = findBrick(brickKey(x, y, z), cursor);
+		if (offset < 0)
+			return nullptr;
+		return &m_cells[offset + cellInBrick(x, y, z)];
+	}
+
+	/** Stores a sample index into a cell (overwrites the previous one if any), allocating its brick if needed (not thread-safe). */
+	void insert(int x, int y, int z, int sample_index, Cursor & cursor)
+	{
+		assert(x >= 0 && x < m_grid_size && y >= 0 && y < m_grid_size && z >= 0 && z < m_grid_size);
+		const uint64_t key = brickKey(x, y, z);
+		int offset = findBrick(key, cursor);
+		if (offset < 0)
+		{
+			if (2 * (m_num_bricks + 1) > m_keys.size())
+				grow();
+			offset = (int)m_cells.size();
+			m_cells.resize(m_cells.size() + BRICK_CELLS, -1);
+			insertBrick(key, offset);
+		}
+		m_cells[offset + cellInBrick(x, y, z)] = sample_index;
+	}
+
+	inline size_t getNumBricks() const { return m_num_bricks; }
+
+private:
+
+	inline uint64_t brickKey(int x, int y, int z) const
+	{
+		const uint64_t n = (uint64_t)m_bricks_per_axis;
+		return ((uint64_t)(z >> BRICK_SHIFT) * n + (uint64_t)(y >> BRICK_SHIFT)) * n + (uint64_t)(x >> BRICK_SHIFT);
+	}
+
+	static inline int cellInBrick(int x, int y, int z)
+	{
+		const int m = BRICK_SIZE - 1;
+		return (((z & m) << BRICK_SHIFT) + (y & m)) * BRICK_SIZE + (x & m);
+	}
+
+	static inline size_t hashKey(uint64_t key)
+	{
+		// splitmix64 finalizer
+		key ^= key >> 30;
+		key *= 0xbf58476d1ce4e5b9ull;
+		key ^= key >> 27;
+		key *= 0x94d049bb133111ebull;
+		key ^= key >> 31;
+		return (size_t)key;
+	}
+
+	/** @returns The offset of the brick in m_cells, or -1 if the brick is not allocated. */
+	inline int findBrick(uint64_t key, Cursor & cursor) const
+	{
+		if (key == cursor.key)
+			return cursor.offset;
+		for (size_t slot = hashKey(key) & m_mask; m_keys[slot] != EMPTY_BRICK_KEY; slot = (slot + 1) & m_mask)
+		{
+			if (m_keys[slot] == key)
+			{
+				cursor.key = key;
+				cursor.offset = m_offsets[slot];
+				return cursor.offset;
+			}
+		}
+		return -1;
+	}
+
+	void insertBrick(uint64_t key, int offset)
+	{
+		size_t slot = hashKey(key) & m_mask;
+		while (m_keys[slot] != EMPTY_BRICK_KEY)
+			slot = (slot + 1) & m_mask;
+		m_keys[slot] = key;
+		m_offsets[slot] = offset;
+		m_num_bricks++;
+	}
+
+	void grow()
+	{
+		std::vector<uint64_t> keys(2 * m_keys.size(), EMPTY_BRICK_KEY);
+		std::vector<int> offsets(keys.size());
+		keys.swap(m_keys);
+		offsets.swap(m_offsets);
+		m_mask = m_keys.size() - 1;
+		m_num_bricks = 0;
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			if (keys[i] != EMPTY_BRICK_KEY)
+				insertBrick(keys[i], offsets[i]);
+		}
+	}
+
+	std::vector<uint64_t> m_keys;/// hash table : brick keys
+	std::vector<int> m_offsets;/// hash table : offsets of the bricks in m_cells
+	std::vector<int> m_cells;/// storage of all allocated bricks (sample index per cell, or -1)
+	size_t m_mask = 0;
+	size_t m_num_bricks = 0;
+	int m_grid_size;
+	int m_bricks_per_axis;
+};
+
+
+/** @returns A candidate sample at a random distance in [r, 2r] from p, in the tangent plane of the sphere at p, projected back onto the sphere. */
+static inline math::dvec3 makeCandidate(std::mt19937 & prng, const math::dvec3 & p, const tool::MonoVectorFrame & tangentFrame, double poisson_radius, double sphere_radius)
+{
+	math::dvec3 offset(0.0);
+	do {
+		offset.x = -1.0 + 2.0*(double)(prng() % 65536) / 65535.0;
+		offset.y = -1.0 + 2.0*(double)(prng() % 65536) / 65535.0;
+	} while (math::length(offset) < 0.001);
+
+	offset = math::normalize(offset);
+	offset *= poisson_radius * (1.0 + (double)(prng() % 65536) / 65535.0);
+
+	math::dvec3 candidateSample = p + offset.x * tangentFrame.t + offset.y * tangentFrame.b;
+	return sphere_radius * math::normalize(candidateSample);
+}
+
+static inline uint64_t mixSeed(uint64_t x)
+{
+	// splitmix64
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
 
 void PoissonSphereSampling::sample(double sphere_radius, double poisson_radius)
 {
 	m_sphere_radius = sphere_radius;
 	m_poisson_radius = poisson_radius;
 
-	// build acceleration structure
+	// build acceleration structure (only the cells around the sphere surface are allocated)
 	const double cell_size = m_poisson_radius / std::sqrt(3.0);
 	const int GRID_SIZE = 2 * ((int)std::floor(m_sphere_radius / cell_size) + 1);
-	const int GRID_SIZE_SQUARE = GRID_SIZE * GRID_SIZE;
-	const int GRID_SIZE_CUBE = GRID_SIZE_SQUARE * GRID_SIZE;
-	int * grid = new int[GRID_SIZE_CUBE];
-	for (int i = 0; i < GRID_SIZE_CUBE; ++i)
-		grid[i] = -1;
-	std::cout << "Fast Poisson sphere sampling using grid size: " << GRID_SIZE << std::endl;
+	const double expected_samples = 4.0 * PI * m_sphere_radius * m_sphere_radius / (1.25 * m_poisson_radius * m_poisson_radius);// empirical density of the sampling
+	SphereShellGrid grid(GRID_SIZE, (size_t)expected_samples);
+	SphereShellGrid::Cursor cursor;
+	std::cout << "Fast Poisson sphere sampling using sparse grid size: " << GRID_SIZE << std::endl;
 
 	// start with the 6 initial octahedron vertices
-	m_samples.reserve(500000);
+	m_samples.reserve((size_t)expected_samples);
 
 	std::vector<int> active_list;
-	active_list.reserve(500000);
+	active_list.reserve((size_t)expected_samples);
 
 	math::dvec3 v;
 	math::ivec3 vi;
-	int i;
 	const double sq2 = std::sqrt(2.0);
 
 	v = math::dvec3(0.0, 0.0, 1.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 0;
+	grid.insert(vi.x, vi.y, vi.z, 0, cursor);
 	active_list.push_back(0);
 
 	v = math::dvec3(0.0, 0.0, -1.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 1;
+	grid.insert(vi.x, vi.y, vi.z, 1, cursor);
 	active_list.push_back(1);
 
 	v = math::dvec3(-1.0, 0.0, 0.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 2;
+	grid.insert(vi.x, vi.y, vi.z, 2, cursor);
 	active_list.push_back(2);
 
 	v = math::dvec3(0.0, -1.0, 0.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 3;
+	grid.insert(vi.x, vi.y, vi.z, 3, cursor);
 	active_list.push_back(3);
 
 	v = math::dvec3(1.0, 0.0, 0.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 4;
+	grid.insert(vi.x, vi.y, vi.z, 4, cursor);
 	active_list.push_back(4);
 
 	v = math::dvec3(0.0, 1.0, 0.0) * m_sphere_radius;
 	vi.x = (int)std::floor(v.x / cell_size) + GRID_SIZE / 2;
 	vi.y = (int)std::floor(v.y / cell_size) + GRID_SIZE / 2;
 	vi.z = (int)std::floor(v.z / cell_size) + GRID_SIZE / 2;
-	i = vi.z * GRID_SIZE * GRID_SIZE + vi.y * GRID_SIZE + vi.x;
-	assert(i >= 0 && i < GRID_SIZE_CUBE);
 	m_samples.push_back(v);
-	grid[i] = 5;
+	grid.insert(vi.x, vi.y, vi.z, 5, cursor);
 	active_list.push_back(5);
 
 	// perform fast poisson sampling (see Bridson : https://www.cct.lsu.edu/~fharhad/ganbatte/siggraph2007/CD2/content/sketches/0250.pdf)
@@ -104,17 +321,7 @@ void PoissonSphereSampling::sample(double sphere_radius, double poisson_radius)
 
 		for (int t = 0; t < max_candidates; ++t)
 		{
-			math::dvec3 offset(0.0);
-			do {
-				offset.x = -1.0 + 2.0*(double)(prng() % 65536) / 65535.0;
-				offset.y = -1.0 + 2.0*(double)(prng() % 65536) / 65535.0;
-			} while (math::length(offset) < 0.001);
-
-			offset = math::normalize(offset);
-			offset *= m_poisson_radius * (1.0 + (double)(prng() % 65536) / 65535.0);
-
-			math::dvec3 candidateSample = p + offset.x * tangentFrame.t + offset.y * tangentFrame.b;
-			candidateSample = m_sphere_radius * math::normalize(candidateSample);
+			const math::dvec3 candidateSample = makeCandidate(prng, p, tangentFrame, m_poisson_radius, m_sphere_radius);
 
 			math::ivec3 cell;
 			cell.x = (int)std::floor(candidateSample.x / cell_size) + GRID_SIZE / 2;
@@ -132,14 +339,7 @@ void PoissonSphereSampling::sample(double sphere_radius, double poisson_radius)
 						break;
 					for (int i = -1; i <= 1; ++i)
 					{
-						int X, Y, Z;
-						X = cell.x + i;
-						Y = cell.y + j;
-						Z = cell.z + k;
-						if (X < 0 || X >= GRID_SIZE || Y < 0 || Y >= GRID_SIZE || Z < 0 || Z >= GRID_SIZE)
-							continue;
-						const int cell_index = Z * GRID_SIZE_SQUARE + Y * GRID_SIZE + X;
-						const int sample_index = grid[cell_index];
+						const int sample_index = grid.find(cell.x + i, cell.y + j, cell.z + k, cursor);
 						if (sample_index == -1)
 							continue;
 
@@ -155,7 +355,7 @@ void PoissonSphereSampling::sample(double sphere_radius, double poisson_radius)
 			if (!bad_candidate)
 			{
 				const int new_sample_index = m_samples.size();
-				grid[cell.z * GRID_SIZE_SQUARE + cell.y * GRID_SIZE + cell.x] = new_sample_index;
+				grid.insert(cell.x, cell.y, cell.z, new_sample_index, cursor);
 				m_samples.push_back(candidateSample);
 				active_list.push_back(new_sample_index);
 				reject = false;
@@ -171,7 +371,206 @@ void PoissonSphereSampling::sample(double sphere_radius, double poisson_radius)
 		}
 	}
 
-	// cleanup
-	delete[] grid;
-	std::cout << "Poisson sampling: " << m_samples.size() << " samples generated." << std::endl;
+	std::cout << "Poisson sampling: " << m_samples.size() << " samples generated (" << grid.getNumBricks() << " grid bricks used)." << std::endl;
+}
+
+
+void PoissonSphereSampling::sampleParallel(double sphere_radius, double poisson_radius, unsigned int seed, unsigned int num_threads, const RadiusFunction & radius_function)
+{
+	m_sphere_radius = sphere_radius;
+	m_poisson_radius = poisson_radius;
+	m_samples.clear();
+	if (num_threads == 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// build acceleration structure : all the bricks crossed by the sphere surface are allocated upfront so that tiles can be sampled concurrently
+	const double cell_size = m_poisson_radius / std::sqrt(3.0);
+	const int GRID_SIZE = 2 * ((int)std::floor(m_sphere_radius / cell_size) + 1);
+	const double expected_samples = 4.0 * PI * m_sphere_radius * m_sphere_radius / (1.25 * m_poisson_radius * m_poisson_radius);// empirical density of the sampling
+	SphereShellGrid grid(GRID_SIZE, (size_t)expected_samples);
+	std::vector<math::ivec3> bricks;
+	bricks.reserve((size_t)expected_samples / 3);
+	grid.allocateShell(m_sphere_radius, cell_size, bricks);
+	std::cout << "Parallel Poisson sphere sampling using sparse grid size: " << GRID_SIZE << " (" << bricks.size() << " bricks, " << num_threads << " threads)" << std::endl;
+
+	auto cellOf = [cell_size, GRID_SIZE](const math::dvec3 & v) {
+		return math::ivec3((int)std::floor(v.x / cell_size) + GRID_SIZE / 2, (int)std::floor(v.y / cell_size) + GRID_SIZE / 2, (int)std::floor(v.z / cell_size) + GRID_SIZE / 2);
+	};
+
+	m_samples.reserve((size_t)expected_samples);
+
+	// start with the 6 initial octahedron vertices (SphericalDelaunay expects them first, in this order)
+	const math::dvec3 octahedron[6] = {
+		math::dvec3(0.0, 0.0, 1.0), math::dvec3(0.0, 0.0, -1.0), math::dvec3(-1.0, 0.0, 0.0),
+		math::dvec3(0.0, -1.0, 0.0), math::dvec3(1.0, 0.0, 0.0), math::dvec3(0.0, 1.0, 0.0)
+	};
+	SphereShellGrid::Cursor cursor;
+	for (int k = 0; k < 6; ++k)
+	{
+		const math::dvec3 v = octahedron[k] * m_sphere_radius;
+		const math::ivec3 vi = cellOf(v);
+		grid.insert(vi.x, vi.y, vi.z, k, cursor);
+		m_samples.push_back(v);
+	}
+
+	// group bricks into tiles of TILE_BRICKS^3 bricks. Tiles are colored by the parity of their coordinates : two tiles of the same color
+	// are at least one tile apart (far more than the poisson radius), so that all tiles of a color can be sampled concurrently (8 phases).
+	const int TILE_BRICKS = 8;
+	const int TILE_CELLS = TILE_BRICKS * SphereShellGrid::BRICK_SIZE;
+	const uint64_t TILES_PER_AXIS = (uint64_t)((GRID_SIZE + TILE_CELLS - 1) / TILE_CELLS);
+	struct Tile
+	{
+		math::ivec3 coords;
+		uint64_t key;
+		std::vector<math::ivec3> bricks;
+		std::vector<math::dvec3> samples;/// samples generated during the current phase (not yet in m_samples)
+	};
+	std::vector<Tile> tiles;
+	std::map<uint64_t, int> tile_lut;
+	for (const math::ivec3 & brick : bricks)
+	{
+		const math::ivec3 tc = brick / TILE_BRICKS;
+		const uint64_t key = ((uint64_t)tc.z * TILES_PER_AXIS + (uint64_t)tc.y) * TILES_PER_AXIS + (uint64_t)tc.x;
+		auto it = tile_lut.find(key);
+		if (it == tile_lut.end())
+		{
+			it = tile_lut.insert(std::make_pair(key, (int)tiles.size())).first;
+			tiles.push_back({ tc, key, {}, {} });
+		}
+		tiles[it->second].bricks.push_back(brick);
+	}
+	std::vector<int> phases[8];
+	for (auto it = tile_lut.cbegin(); it != tile_lut.cend(); ++it)
+	{
+		const math::ivec3 & tc = tiles[it->second].coords;
+		phases[(tc.x & 1) | ((tc.y & 1) << 1) | ((tc.z & 1) << 2)].push_back(it->second);
+	}
+
+	// Bridson sampling (see sample()) restricted to one tile. The tile is seeded by one dart per brick, each accepted dart is grown until no more room is left.
+	// Grid cells of the current tile store -2 - (index into tile.samples) until the end of the phase.
+	const double brick_size = SphereShellGrid::BRICK_SIZE * cell_size;
+	const double origin = -(GRID_SIZE / 2) * cell_size;
+	// With a radius function, the local radius is evaluated once per brick (at its center) and the neighborhood searched around a candidate
+	// grows with it, so that a radius of n * poisson_radius behaves exactly as a uniform sampling at that radius.
+	const double max_radius = MAX_RADIUS_RATIO * m_poisson_radius;
+	auto sampleTile = [&](Tile & tile)
+	{
+		std::mt19937 prng((std::mt19937::result_type)mixSeed(mixSeed(seed) ^ tile.key));
+		SphereShellGrid::Cursor cursor;
+		const math::ivec3 cmin = tile.coords * TILE_CELLS;
+		const math::ivec3 cmax = cmin + TILE_CELLS;
+		std::vector<int> active_list;
+
+		std::vector<double> brick_radius;
+		if (radius_function)
+		{
+			brick_radius.assign(TILE_BRICKS * TILE_BRICKS * TILE_BRICKS, m_poisson_radius);
+			for (const math::ivec3 & brick : tile.bricks)
+			{
+				const math::ivec3 b = brick - tile.coords * TILE_BRICKS;
+				const math::dvec3 center = math::dvec3(origin) + brick_size * (math::dvec3(brick) + 0.5);
+				const double r = radius_function(m_sphere_radius * math::normalize(center));
+				brick_radius[(b.z * TILE_BRICKS + b.y) * TILE_BRICKS + b.x] = math::clamp(r, m_poisson_radius, max_radius);
+			}
+		}
+		auto localRadius = [&](const math::ivec3 & cell) -> double
+		{
+			if (brick_radius.empty())
+				return m_poisson_radius;
+			const math::ivec3 b = (cell - cmin) / SphereShellGrid::BRICK_SIZE;
+			return brick_radius[(b.z * TILE_BRICKS + b.y) * TILE_BRICKS + b.x];
+		};
+
+		auto tryInsert = [&](const math::dvec3 & candidateSample) -> bool
+		{
+			const math::ivec3 cell = cellOf(candidateSample);
+			if (cell.x < cmin.x || cell.y < cmin.y || cell.z < cmin.z || cell.x >= cmax.x || cell.y >= cmax.y || cell.z >= cmax.z)
+				return false;
+			int * target = grid.getCell(cell.x, cell.y, cell.z, cursor);
+			if (target == nullptr)
+				return false;
+			const double radius = localRadius(cell);
+			const int range = (int)std::ceil(radius / m_poisson_radius - 1e-9);
+			for (int k = -range; k <= range; ++k)
+				for (int j = -range; j <= range; ++j)
+					for (int i = -range; i <= range; ++i)
+					{
+						const int sample_index = grid.find(cell.x + i, cell.y + j, cell.z + k, cursor);
+						if (sample_index == -1)
+							continue;
+						const math::dvec3 & q = sample_index >= 0 ? m_samples[sample_index] : tile.samples[-2 - sample_index];
+						if (math::distance(candidateSample, q) < radius)
+							return false;
+					}
+			active_list.push_back((int)tile.samples.size());
+			*target = -2 - (int)tile.samples.size();
+			tile.samples.push_back(candidateSample);
+			return true;
+		};
+
+		const int max_candidates = 32;
+		for (const math::ivec3 & brick : tile.bricks)
+		{
+			math::dvec3 dart;
+			dart.x = origin + brick_size * (brick.x + (double)(prng() % 65536) / 65536.0);
+			dart.y = origin + brick_size * (brick.y + (double)(prng() % 65536) / 65536.0);
+			dart.z = origin + brick_size * (brick.z + (double)(prng() % 65536) / 65536.0);
+			if (math::length(dart) < 1e-6 * m_sphere_radius || !tryInsert(m_sphere_radius * math::normalize(dart)))
+				continue;
+
+			while (!active_list.empty())
+			{
+				const int active_index = prng() % active_list.size();
+				const math::dvec3 p = tile.samples[active_list[active_index]];
+				const tool::MonoVectorFrame tangentFrame(math::normalize(p));
+				const double radius = localRadius(cellOf(p));
+				bool reject = true;
+				for (int t = 0; t < max_candidates; ++t)
+				{
+					if (tryInsert(makeCandidate(prng, p, tangentFrame, radius, m_sphere_radius)))
+					{
+						reject = false;
+						break;
+					}
+				}
+				if (reject)
+				{
+					active_list[active_index] = active_list.back();
+					active_list.pop_back();
+				}
+			}
+		}
+	};
+
+	for (int phase = 0; phase < 8; ++phase)
+	{
+		const std::vector<int> & phase_tiles = phases[phase];
+		std::atomic<int> next_tile(0);
+		auto worker = [&]()
+		{
+			for (int i = next_tile++; i < (int)phase_tiles.size(); i = next_tile++)
+				sampleTile(tiles[phase_tiles[i]]);
+		};
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < num_threads; ++t)
+			threads.emplace_back(worker);
+		worker();
+		for (std::thread & thread : threads)
+			thread.join();
+
+		// publish the samples of this phase, in tile order (the result does not depend on the number of threads)
+		for (int t : phase_tiles)
+		{
+			Tile & tile = tiles[t];
+			for (const math::dvec3 & s : tile.samples)
+			{
+				const math::ivec3 cell = cellOf(s);
+				*grid.getCell(cell.x, cell.y, cell.z, cursor) = (int)m_samples.size();
+				m_samples.push_back(s);
+			}
+			std::vector<math::dvec3>().swap(tile.samples);
+		}
+	}
+
+	std::cout << "Poisson sampling: " << m_samples.size() << " samples generated (" << tiles.size() << " tiles)." << std::endl;
 }
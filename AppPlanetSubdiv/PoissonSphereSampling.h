@@ -2,16 +2,30 @@
 
 
 #include "tool.h"
+#include <functional>
 #include <vector>
 
 
 class PoissonSphereSampling
 {
 public:
+	/// Local poisson radius at a point of the sphere, for variable density sampling (values are clamped to [poisson_radius, MAX_RADIUS_RATIO * poisson_radius]).
+	typedef std::function<double(const math::dvec3 &)> RadiusFunction;
+	static constexpr double MAX_RADIUS_RATIO = 8.0;
+
 	PoissonSphereSampling() {}
 	~PoissonSphereSampling() {}
 
+	/** Poisson disk sampling of the sphere (Bridson), single threaded. The 6 octahedron vertices are the first 6 samples. */
 	void sample(double sphere_radius, double poisson_radius);
+
+	/**
+	 * Multi-threaded Poisson disk sampling of the sphere. The surface is split into tiles that are sampled concurrently in 8 phases, each tile with its own PRNG stream.
+	 * The result only depends on the seed (not on the number of threads). The 6 octahedron vertices are the first 6 samples.
+	 * @param num_threads Number of worker threads, 0 for the number of hardware threads.
+	 * @param radius_function (optional) Local poisson radius, must be thread-safe. The poisson_radius parameter is then the minimum radius.
+	 */
+	void sampleParallel(double sphere_radius, double poisson_radius, unsigned int seed = 13337, unsigned int num_threads = 0, const RadiusFunction & radius_function = RadiusFunction());
 	inline std::vector<math::dvec3>& getSamples() { return m_samples; }
 
 private:
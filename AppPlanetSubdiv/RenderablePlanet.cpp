@@ -4,37 +4,34 @@
 
 #include <cmath>
 #include <iostream>
-#include <list>
-#include <set>
-#include <unordered_map>
 
 #include <qimage.h>
 
-#include "SphericalDelaunay.h"
-
 
 
 
 bool RenderablePlanet::init(int viewportWidth, int viewportHeight, GLuint default_fbo, std::ostream & shader_log)
 {
-	// --- make base mesh ---
-	auto start = std::chrono::high_resolution_clock::now();
-	
-	makePoissonDelaunayBaseMesh();
-	
-	std::chrono::duration<double> basetime = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start);
-	double minutes = std::floor(basetime.count() / 60.0);
-	double seconds = basetime.count() - 60.0 * minutes;
-	std::cout << std::endl << "=====================================================\nPoisson sampling, spherical delaunay and mesh conversion took : " << minutes << " minutes " << seconds << " seconds." << std::endl;
-
-	std::cout << "Cleaning up coasts + computing base river network ..." << std::endl;
-	createBaseRiverNetwork();
-	postprocessBaseRiverNetwork();
+	// --- make base mesh and base river network (CPU side) ---
+	PlanetBaseBuilder builder(m_planet);
+#ifdef BASE_MESH_ADAPTIVE_DENSITY
+	builder.setAdaptiveDensity(BASE_MESH_ADAPTIVE_DENSITY);
+#endif
+#ifdef BASE_MESH_SDT_CACHE
+	builder.setTriangulationCache(BASE_MESH_SDT_CACHE);
+#endif
+#ifdef BASE_PLANET_CACHE
+	builder.setBakeCache(BASE_PLANET_CACHE);
+#endif
+#ifdef BASE_MESH_PREVIEW_LATTICE
+	builder.setSamplingMethod(SphereSamplingMethod::LATTICE);
+#endif
+	builder.build();
 
-	std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start);
-	minutes = std::floor(time_span.count() / 60.0);
-	seconds = time_span.count() - 60.0 * minutes;
-	std::cout << std::endl << "Total took : " << minutes << " minutes " << seconds << " seconds.\n=====================================================\n" << std::endl;
+	m_base_edges.swap(builder.getEdges());
+	m_base_vertices.swap(builder.getVertices());
+	m_base_triangles.swap(builder.getTriangles());
+	m_base_vattrib.swap(builder.getVertexAttributes());
 
 	// -- initialize opengl video memory and objects --
 	m_viewwidth = viewportWidth;
@@ -50,8 +47,6 @@ bool RenderablePlanet::init(int viewportWidth, int viewportHeight, GLuint defaul
 
 void RenderablePlanet::release()
 {
-	delete[] m_river_nodes;
-
 	glDeleteQueries(1, &m_timequery);
 
 	//glDeleteTextures(1, &m_terrainTextureArray);
@@ -764,194 +759,6 @@ bool RenderablePlanet::doTessellationPass(int lod)
 }
 
 
-void RenderablePlanet::makePoissonDelaunayBaseMesh()
-{
-	const double MINIMUM_EDGE_LENGTH_KM = 40.0;
-
-	// Make a Poisson disk sampling of the surface of the planet
-	// Build a spherical Delaunay triangulation (SDT)
-	SphericalDelaunay sdt(m_planet->radiusKm, MINIMUM_EDGE_LENGTH_KM);
-	//sdt.persistToDisk(std::string("../assets/delaunay/test.sdt"));
-
-	const int vrange = sdt.getVerticesRange();
-	const SphericalVertex * vs = sdt.getVertices();
-	const int trange = sdt.getTrianglesRange();
-	const SphericalTriangle * ts = sdt.getTriangles();
-
-	// Edges construction:
-	std::unordered_map<uint64_t, SphericalEdge> edges;// constant-time-access map
-	for (int i = 0; i < trange; ++i)
-	{
-		const SphericalTriangle & T = ts[i];
-		if (TRIANGLE_DELETED(T))
-			continue;
-
-		int v0 = T.vertex[0];
-		int v1 = T.vertex[1];
-		int v2 = T.vertex[2];
-
-		uint64_t akey01 = sdt.hashEdge(v0, v1);
-		uint64_t akey02 = sdt.hashEdge(v0, v2);
-		uint64_t akey12 = sdt.hashEdge(v1, v2);
-
-		auto it = edges.find(akey01);
-		if (it == edges.end())
-		{
-			SphericalEdge edge01 = { v0, v1, i, -1 };
-			edges[akey01] = edge01;
-		}
-		else
-			it->second.triangle[1] = i;
-
-		it = edges.find(akey02);
-		if (it == edges.end())
-		{
-			SphericalEdge edge02 = { v0, v2, i, -1 };
-			edges[akey02] = edge02;
-		}
-		else
-			it->second.triangle[1] = i;
-
-		it = edges.find(akey12);
-		if (it == edges.end())
-		{
-			SphericalEdge edge12 = { v1, v2, i, -1 };
-			edges[akey12] = edge12;
-		}
-		else
-			it->second.triangle[1] = i;
-	}
-
-	m_base_edges.reserve(edges.size());
-	m_base_vertices.reserve(vrange);
-	m_base_triangles.reserve(3*vrange);
-	m_base_vattrib.reserve(vrange);
-
-	// --- Assign Edges ---
-	std::unordered_map<uint64_t, int> edgeLUT;
-	for (auto it = edges.cbegin(); it != edges.cend(); ++it)
-	{
-		const SphericalEdge edge = it->second;
-		EdgeGPU E;
-		E.child0 = -1;
-		E.child1 = -1;
-		E.vm = -1;
-		E.f0 = edge.triangle[0];
-		E.f1 = edge.triangle[1];
-		E.status = (8u << 16);
-		E.v0 = edge.vertex[0];
-		E.v1 = edge.vertex[1];
-		E.type = TYPE_NONE;
-
-		m_base_edges.push_back(E);
-
-		uint64_t key = sdt.hashEdge(E.v0, E.v1);
-		edgeLUT[key] = m_base_edges.size() - 1;
-	}
-
-	// --- Assign Vertices and Vertex Attributes ---
-	std::set<int> incident_triangles;
-	for (int i = 0; i < vrange; ++i)
-	{
-		const SphericalVertex & vertex = vs[i];
-		if (VERTEX_DELETED(vertex))
-			continue;
-
-		math::dvec3 p = math::normalize(vertex.coordinates);
-
-		const PlanetData::Data data = m_planet->getInterpolatedModelData(p);
-		const float plateaux = m_planet->getPlateauxDistribution(p);
-		const float desert = m_planet->getDesertDistribution(p);
-		const float hills = m_planet->getHillsDistribution(p);
-		double r = (double)(std::rand() % 65536) / 65535.0;
-		double elevation = m_planet->seaLevelKm + (data.elevation - m_planet->seaLevelKm) * (0.7 + 0.3*r);// math::mix(0.4 + 0.6*r, 0.88 - 0.2*r, (double)plateaux); // RANDOMIZE (OR NOT)
-		if (data.elevation <= m_planet->seaLevelKm)
-			elevation = data.elevation;
-		p *= m_planet->radiusKm + elevation;
-		const float tectonic_age = (float)(data.age);
-
-		m_base_vattrib.push_back(
-			{
-			math::dvec4(p, elevation)
-			, math::dvec4(m_planet->seaLevelKm /* nearest river altitude : ad hoc value*/
-				, MINIMUM_EDGE_LENGTH_KM /* distance to river: ad hoc value */
-				, data.elevation /* max crust elevation */
-				, m_planet->seaLevelKm) /* water altitude : ad hoc value*/
-			, math::vec4(0.0f, 0.0f, 0.0f, 0.0f) // water flow : ad hoc value
-			, math::vec4((float)(m_planet->seaLevelKm) /* nearest ravin altitude : ad hoc value*/
-				, MINIMUM_EDGE_LENGTH_KM /* distance to ravin : ad hoc value */
-				, hills, 0.0f)
-			, math::vec4(tectonic_age, plateaux, desert, 0.0f)
-			, math::vec4(0.0)
-			}
-		);
-
-		//---
-		VertexGPU V;
-		V.branch_count = 0;
-		V.seed = std::rand();
-		if (V.seed == 0)
-			V.seed = 1337;
-		V.status = 0;
-		if (elevation > m_planet->seaLevelKm)
-			V.type = TYPE_CONTINENT;
-		else V.type = TYPE_SEA;
-
-		incident_triangles.clear();
-		vertex.getIncidentTriangles(i, ts, incident_triangles);
-		for (int k = 0; k < 4; ++k)
-		{
-			V.faces_0[k] = -1;
-			V.faces_1[k] = -1;
-		}
-		int * f = V.faces_0;
-		int k = 0;
-		for (int t : incident_triangles)
-		{
-			f[k] = t;			
-			k++;
-			if (k == 4)
-			{
-				f = V.faces_1;
-				k = 0;
-			}
-		}
-
-		m_base_vertices.push_back(V);
-	}
-
-
-	// --- Assign Triangles ---
-	for (int i = 0; i < trange; ++i)
-	{
-		const SphericalTriangle & T = ts[i];
-		if (TRIANGLE_DELETED(T))
-			continue;
-
-		uint64_t key0 = sdt.hashEdge(T.vertex[0], T.vertex[1]);
-		uint64_t key1 = sdt.hashEdge(T.vertex[1], T.vertex[2]);
-		uint64_t key2 = sdt.hashEdge(T.vertex[2], T.vertex[0]);
-		
-		TriangleGPU t;
-		t.e0 = edgeLUT[key0];
-		t.e1 = edgeLUT[key1];
-		t.e2 = edgeLUT[key2];
-
-		t.normal_x = 0.0f;
-		t.normal_y = 0.0f;
-		t.normal_z = 0.0f;
-
-		t.status = (8u << 8);
-		t.type = TYPE_NONE;
-
-		m_base_triangles.push_back(t);
-	}
-
-	// --
-	double avg_edge_len = sdt.getAverageTriangleEdgeLength();
-	std::cout << "BASE MESH : " << avg_edge_len << " average edge (km), " << m_base_triangles.size() << " triangles for last and only base LOD." << std::endl;
-}
-
 /*
 /// [unused]
 void RenderablePlanet::getSurroundingVertices(int edge_index, const EdgeGPU & edge, int & va, int & vb) const 
@@ -1157,1123 +964,6 @@ void RenderablePlanet::splitBaseEdge(int edge_index, EdgeGPU & edge)
 }
 */
 
-bool RenderablePlanet::isTriangleSeaCoast(int triangle_index) const
-{
-	int countSea = 0;
-	const TriangleGPU & T = m_base_triangles[triangle_index];
-	const EdgeGPU & e0 = m_base_edges[T.e0];
-	const EdgeGPU & e1 = m_base_edges[T.e1];
-	const EdgeGPU & e2 = m_base_edges[T.e2];
-
-	bool flip0 = false;
-	bool flip1 = false;
-	bool flip2 = false;//determine winding of edges (as they can appear in any order)
-	if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
-		flip0 = true;
-	if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
-		flip1 = true;
-	if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
-		flip2 = true;
-	int v0 = (flip0 ? e0.v1 : e0.v0);
-	int v1 = (flip1 ? e1.v1 : e1.v0);
-	int v2 = (flip2 ? e2.v1 : e2.v0);
-	
-	std::list<int> list;
-	list.push_back(v0);
-	list.push_back(v1);
-	list.push_back(v2);
-	std::set<int> visited;
-	std::vector<int> edges;
-	edges.reserve(16);
-	
-	while (!list.empty())
-	{
-		int v = list.front();
-		list.pop_front();
-		if (visited.find(v) != visited.end())
-			continue;
-		visited.insert(v);
-
-		edges.clear();
-		getAdjacentEdges(v, edges);
-
-		for (int e : edges)
-		{
-			const EdgeGPU &  edge = m_base_edges[e];
-			int v2 = edge.v0 == v ? edge.v1 : edge.v0;
-			if (visited.find(v2) != visited.end())
-				continue;
-			if (m_base_vertices[v2].type == TYPE_SEA)
-			{
-				countSea++;
-				list.push_back(v2);
-			}
-		}
-		if (countSea > 8)
-			return true;
-	}
-
-	return countSea > 8;
-}
-
-void RenderablePlanet::createAllRiverMouth(std::vector<RiverGrowingNode> & nodes)
-{
-	std::mt19937 prng;
-	std::vector<int> coasts;
-
-	// -- assign triangle types and save aside coast triangles --
-	for (int i = 0; i < m_base_triangles.size(); ++i)
-	{
-		TriangleGPU & T = m_base_triangles[i];
-		if ((T.status & 0xFF) != 0)
-			continue;
-
-		EdgeGPU & e0 = m_base_edges[T.e0];
-		EdgeGPU & e1 = m_base_edges[T.e1];
-		EdgeGPU & e2 = m_base_edges[T.e2];
-
-		bool flip0 = false;
-		bool flip1 = false;
-		bool flip2 = false;//determine winding of edges (as they can appear in any order)
-		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
-			flip0 = true;
-		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
-			flip1 = true;
-		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
-			flip2 = true;
-		int v0 = (flip0 ? e0.v1 : e0.v0);
-		int v1 = (flip1 ? e1.v1 : e1.v0);
-		int v2 = (flip2 ? e2.v1 : e2.v0);
-		VertexGPU & V0 = m_base_vertices[v0];
-		VertexGPU & V1 = m_base_vertices[v1];
-		VertexGPU & V2 = m_base_vertices[v2];
-
-		int count = 0;
-		if (V0.type == TYPE_SEA)
-			count++;
-		if (V1.type == TYPE_SEA) // sea vertex
-			count++;
-		if (V2.type == TYPE_SEA) // sea vertex
-			count++;
-		if (count == 0)
-		{
-			T.type = TYPE_CONTINENT;
-			continue;
-		}
-		if (count == 3)
-		{
-			T.type = TYPE_SEA;
-			continue;
-		}
-
-		T.type = TYPE_COAST;
-		if (count == 2)
-			coasts.push_back(i);
-	}
-
-	// -- make clean coast triangles (ie., without any sea vertex) --
-	for (int t : coasts)
-	{
-		TriangleGPU & T = m_base_triangles[t];
-		EdgeGPU & e0 = m_base_edges[T.e0];
-		EdgeGPU & e1 = m_base_edges[T.e1];
-		EdgeGPU & e2 = m_base_edges[T.e2];
-
-		bool flip0 = false;
-		bool flip1 = false;
-		bool flip2 = false;//determine winding of edges (as they can appear in any order)
-		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
-			flip0 = true;
-		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
-			flip1 = true;
-		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
-			flip2 = true;
-		int v0 = (flip0 ? e0.v1 : e0.v0);
-		int v1 = (flip1 ? e1.v1 : e1.v0);
-		int v2 = (flip2 ? e2.v1 : e2.v0);
-		VertexGPU & V0 = m_base_vertices[v0];
-		VertexGPU & V1 = m_base_vertices[v1];
-		VertexGPU & V2 = m_base_vertices[v2];
-
-		int cv;
-		if (V0.type == TYPE_CONTINENT)
-			cv = v0;
-		else if (V1.type == TYPE_CONTINENT)
-			cv = v1;
-		else cv = v2;
-		const double ref_altitude = m_base_vattrib[cv].position.w;
-
-		if (V0.type == TYPE_SEA)
-		{
-			V0.type = TYPE_COAST;
-			math::dvec4 va = m_base_vattrib[v0].position;
-			math::dvec4 vd = m_base_vattrib[v0].data;
-			m_base_vattrib[v0].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
-			math::dvec3 p(va);
-			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
-			m_base_vattrib[v0].position = math::dvec4(p, ref_altitude);			
-		}
-		if (V1.type == TYPE_SEA)
-		{
-			V1.type = TYPE_COAST;
-			math::dvec4 va = m_base_vattrib[v1].position;
-			math::dvec4 vd = m_base_vattrib[v1].data;
-			m_base_vattrib[v1].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
-			math::dvec3 p(va);
-			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
-			m_base_vattrib[v1].position = math::dvec4(p, ref_altitude);
-		}
-		if (V2.type == TYPE_SEA)
-		{
-			V2.type = TYPE_COAST;
-			math::dvec4 va = m_base_vattrib[v2].position;
-			math::dvec4 vd = m_base_vattrib[v2].data;
-			m_base_vattrib[v2].data = math::dvec4(vd.x, vd.y, ref_altitude, vd.w);
-			math::dvec3 p(va);
-			p = normalize(p) * (m_planet->radiusKm + ref_altitude);
-			m_base_vattrib[v2].position = math::dvec4(p, ref_altitude);
-		}
-	}
-
-	// -- create starting point for rivers (river mouth) --
-	std::vector<int> adjacency;
-	adjacency.reserve(16);
-	for (int i : coasts)
-	{
-		TriangleGPU & T = m_base_triangles[i];
-		EdgeGPU & e0 = m_base_edges[T.e0];
-		EdgeGPU & e1 = m_base_edges[T.e1];
-		EdgeGPU & e2 = m_base_edges[T.e2];
-
-		bool flip0 = false;
-		bool flip1 = false;
-		bool flip2 = false;//determine winding of edges (as they can appear in any order)
-		if (e0.v0 == e1.v0 || e0.v0 == e1.v1)
-			flip0 = true;
-		if (e1.v0 == e2.v0 || e1.v0 == e2.v1)
-			flip1 = true;
-		if (e2.v0 == e0.v0 || e2.v0 == e0.v1)
-			flip2 = true;
-		int v0 = (flip0 ? e0.v1 : e0.v0);
-		int v1 = (flip1 ? e1.v1 : e1.v0);
-		int v2 = (flip2 ? e2.v1 : e2.v0);
-		VertexGPU & V0 = m_base_vertices[v0];
-		VertexGPU & V1 = m_base_vertices[v1];
-		VertexGPU & V2 = m_base_vertices[v2];
-		
-		if (V0.type == TYPE_RIVER || V1.type == TYPE_RIVER || V2.type == TYPE_RIVER)
-			continue;
-
-		double a0 = m_base_vattrib[v0].position.w - m_planet->seaLevelKm;
-		double a1 = m_base_vattrib[v1].position.w - m_planet->seaLevelKm;
-		double a2 = m_base_vattrib[v2].position.w - m_planet->seaLevelKm;
-		//if (a0 > 1.7 && a1 > 1.7 && a2 > 1.7)// make sure mountainous coast (1700 m) don't become river mouth
-			//continue;
-
-		if (V0.type == TYPE_COAST)
-		{// make sure no neighbor vertex is of type River:
-			bool nogood = false;
-			adjacency.clear();
-			getAdjacentEdges(v0, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == v0 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_RIVER)
-				{
-					nogood = true;
-					break;
-				}
-			}
-			if (nogood)
-				continue;
-		}
-		if (V1.type == TYPE_COAST)
-		{// make sure no neighbor vertex is of type River:
-			bool nogood = false;
-			adjacency.clear();
-			getAdjacentEdges(v1, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == v1 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_RIVER)
-				{
-					nogood = true;
-					break;
-				}
-			}
-			if (nogood)
-				continue;
-		}
-		if (V2.type == TYPE_COAST)
-		{// make sure no neighbor vertex is of type River:
-			bool nogood = false;
-			adjacency.clear();
-			getAdjacentEdges(v2, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == v2 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_RIVER)
-				{
-					nogood = true;
-					break;
-				}
-			}
-			if (nogood)
-				continue;
-		}
-		
-		if (!isTriangleSeaCoast(i))
-			continue;
-
-		RiverGrowingNode node;
-		int n0 = e0.f0 == i ? e0.f1 : e0.f0;
-		int n1 = e1.f0 == i ? e1.f1 : e1.f0;
-		int n2 = e2.f0 == i ? e2.f1 : e2.f0;
-		int ne, nv0, nv1;
-		math::dvec3 p;
-		int mouth_index;
-
-		if (m_base_triangles[n0].type == TYPE_SEA && m_base_triangles[n1].type != TYPE_SEA && m_base_triangles[n2].type != TYPE_SEA)
-		{
-			if (V1.type == TYPE_COAST)
-			{
-				ne = T.e1;
-				nv0 = v2;
-				nv1 = v1;
-			}
-			else {
-				ne = T.e2;
-				nv0 = v2;
-				nv1 = v0;
-			}
-			node.edge = ne;
-			node.tip_vertex = nv0;			
-
-			// check that, indeed, the candidate river mouth has a connexion to the sea
-			bool has_sea_outlet = false;
-			adjacency.clear();
-			getAdjacentEdges(nv1, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == nv1 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_SEA)
-				{
-					has_sea_outlet = true;
-					break;
-				}
-			}
-			if (!has_sea_outlet)
-				continue;
-
-			// river mouth:
-			mouth_index = nv1;			
-		}
-		else if (m_base_triangles[n1].type == TYPE_SEA && m_base_triangles[n0].type != TYPE_SEA && m_base_triangles[n2].type != TYPE_SEA)
-		{
-			if (V1.type == TYPE_COAST)
-			{
-				ne = T.e0;
-				nv0 = v0;
-				nv1 = v1;
-			}
-			else {
-				ne = T.e2;
-				nv0 = v0;
-				nv1 = v2;
-			}
-			node.edge = ne;
-			node.tip_vertex = nv0;
-
-			// check that, indeed, the candidate river mouth has a connexion to the sea
-			bool has_sea_outlet = false;
-			adjacency.clear();
-			getAdjacentEdges(nv1, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == nv1 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_SEA)
-				{
-					has_sea_outlet = true;
-					break;
-				}
-			}
-			if (!has_sea_outlet)
-				continue;
-
-			// river mouth:
-			mouth_index = nv1;
-		}
-		else if (m_base_triangles[n2].type == TYPE_SEA && m_base_triangles[n1].type != TYPE_SEA && m_base_triangles[n0].type != TYPE_SEA)
-		{
-			if (V0.type == TYPE_COAST)
-			{
-				ne = T.e0;
-				nv0 = v1;
-				nv1 = v0;
-			}
-			else {
-				ne = T.e1;
-				nv0 = v1;
-				nv1 = v2;
-			}
-			node.edge = ne;
-			node.tip_vertex = nv0;
-
-			// check that, indeed, the candidate river mouth has a connexion to the sea
-			bool has_sea_outlet = false;
-			adjacency.clear();
-			getAdjacentEdges(nv1, adjacency);
-			for (int e : adjacency)
-			{
-				const EdgeGPU & edge = m_base_edges[e];
-				int w = edge.v0 == nv1 ? edge.v1 : edge.v0;
-				if (m_base_vertices[w].type == TYPE_SEA)
-				{
-					has_sea_outlet = true;
-					break;
-				}
-			}
-			if (!has_sea_outlet)
-				continue;
-
-			// river mouth:
-			mouth_index = nv1;			
-		}
-		else
-			continue;
-
-		math::dvec4 va = m_base_vattrib[node.tip_vertex].position;
-		double r = (double)(prng() % 65536) / 65535.0;
-		double altitude_tip = (0.99 + 0.005 * r) * m_planet->seaLevelKm;//bottom of river is somewhere in ] -100m, -50m]
-		math::dvec3 p_tip = (m_planet->radiusKm + altitude_tip) * math::normalize(math::dvec3(va));
-
-		node.num_edges_to_mouth = 1.0;
-		node.length_to_mouth = 0.0;
-		r = (double)(prng() % 65536) / 65535.0;
-		r = std::pow(r, 0.75);
-		node.target_river_length = std::max(500.0, r * MAX_RIVER_LENGTH);
-		node.spring = false;
-		node.full_grown = false;
-		node.normalized_tecto_altitude = (m_base_vattrib[node.tip_vertex].data.z - m_planet->seaLevelKm)/ m_planet->maxAltitude;
-		node.priority = 1.0f;// r;
-		node.base_vertex = mouth_index;		
-		const float flowvalue = 0.1f + 0.9f * (float)r * (0.618f + 0.382f * (prng() % 65536) / 65535.0f);
-
-		m_base_vertices[mouth_index].type = TYPE_RIVER;
-		va = m_base_vattrib[mouth_index].position;
-		r = (double)(prng() % 65536) / 65535.0;
-		double altitude_mouth = (0.98 + 0.01 * r) * m_planet->seaLevelKm;// bottom of river mouth is somewhere in ]-100m, -200m]
-		p = (m_planet->radiusKm + altitude_mouth) * math::normalize(math::dvec3(va));
-		m_base_vattrib[mouth_index].position = math::dvec4(p, altitude_mouth);
-		m_base_vattrib[mouth_index].data.x = altitude_mouth;//river bed altitude
-		m_base_vattrib[mouth_index].data.y = 0.0;//distance to river is 0
-		math::vec3 flow_dir = math::vec3(math::normalize(p - p_tip));
-		m_base_vattrib[mouth_index].flow = math::vec4(flow_dir, flowvalue);//normalized direction of the flow and normalized flow quantity
-		m_base_vattrib[mouth_index].misc2.w = (float)r;//random river profile for now.
-		//m_base_vattrib[mouth_index].padding_and_debug.w = (float)(node.target_river_length / MAX_RIVER_LENGTH);
-		m_base_vattrib[mouth_index].padding_and_debug.w = (float)node.priority;
-
-		m_base_edges[node.edge].type = TYPE_RIVER;
-		m_base_vertices[node.tip_vertex].type = TYPE_RIVER;
-		m_base_vattrib[node.tip_vertex].position = math::dvec4(p_tip, altitude_tip);
-		m_base_vattrib[node.tip_vertex].data.x = altitude_tip;
-		m_base_vattrib[node.tip_vertex].data.y = 0.0;		
-		m_base_vattrib[node.tip_vertex].flow = math::vec4(flow_dir, flowvalue);
-		m_base_vattrib[node.tip_vertex].misc2.w = m_base_vattrib[mouth_index].misc2.w;
-		//m_base_vattrib[node.tip_vertex].padding_and_debug.w = (float)(node.target_river_length / MAX_RIVER_LENGTH);
-		m_base_vattrib[node.tip_vertex].padding_and_debug.w = (float)node.priority;
-		node.max_flow_value = flowvalue;
-		nodes.push_back(node);
-	}
-}
-
-static bool compareBaseRiverNodeIteratorStochastic(const std::list<RiverGrowingNode>::iterator & A, const std::list<RiverGrowingNode>::iterator & B, double randomVal)
-{
-	return (A->priority * (1.0 - A->normalized_tecto_altitude) * (0.5 + 0.5*randomVal)) > (B->priority * (1.0 - B->normalized_tecto_altitude));
-}
-
-static bool compareBaseRiverNodeIterator(const std::list<RiverGrowingNode>::iterator & A, const std::list<RiverGrowingNode>::iterator & B)
-{
-	return (A->priority * (1.0 - A->normalized_tecto_altitude)) > (B->priority * (1.0 - B->normalized_tecto_altitude));
-}
-
-static bool compareBaseRiverNode(const RiverGrowingNode & A, const RiverGrowingNode & B)
-{
-	return A.choice_penalty < B.choice_penalty;
-}
-
-void RenderablePlanet::createBaseRiverNetwork()
-{
-	MAX_RIVER_LENGTH = m_planet->radiusKm * 1.6;
-
-	std::mt19937 prng;
-	std::vector<RiverGrowingNode> mouths;
-	
-	// -- track elevated base vertices (aka mountain vertices) --
-#ifdef BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS
-	struct MountainVertex
-	{
-		math::dvec4 position;
-		int index;
-	};
-	std::vector<MountainVertex> mountains;
-	mountains.reserve((int)std::sqrt((double)m_base_vertices.size()));
-	for (int i = 0; i < m_base_vertices.size(); ++i)
-	{
-		math::dvec4 p = m_base_vattrib[i].position;
-		if (p.w > m_planet->seaLevelKm + 1.0) // above 1000m altitude
-		{
-			mountains.push_back({ p, i });
-		}
-	}
-#endif
-
-	// -- assign all river mouth (and make clear cut coasts) -- 
-	createAllRiverMouth(mouths);
-	std::list<RiverGrowingNode> nodes(mouths.begin(), mouths.end());
-
-	std::vector<RiverGrowingNode> candidates;
-	candidates.reserve(16);
-	std::vector<int> adjacency, tip_adjacency;
-	adjacency.reserve(16);
-	tip_adjacency.reserve(16);
-
-	std::vector<RiverGrowingNode> branch_list;
-	branch_list.reserve(mouths.size() * 32);
-	std::vector<std::list<RiverGrowingNode>::iterator> to_delete;
-	to_delete.reserve(mouths.size() * 32);
-	std::vector<std::list<RiverGrowingNode>::iterator> sorted_node_iterators;
-	sorted_node_iterators.reserve(mouths.size() * 32);
-
-	m_river_nodes_max_size = m_base_vertices.size();
-	m_river_nodes = new RiverNode[m_river_nodes_max_size];
-	m_river_nodes_size = 0;
-	
-	int c = 0;
-	for (auto it = nodes.begin(); it != nodes.end(); ++it)
-	{
-		m_rivers.push_back(m_river_nodes_size);
-
-		m_river_nodes[m_river_nodes_size] = { 
-			it->base_vertex,
-			-1,
-			m_river_nodes_size + 1, -1,
-			it->edge, -1,
-			0.0f,
-			-1, 
-			-1.0f,
-			-1
-			, 0.0,
-			c, //river_system_id
-			false
-			};		
-		m_river_nodes_size++;
-		
-		it->tip_river_node = m_river_nodes_size;
-
-		m_river_nodes[m_river_nodes_size] = {
-			it->tip_vertex,
-			m_river_nodes_size - 1,
-			-1, -1,
-			-1, -1, 
-			0.0f,
-			-1,
-			-1.0f,
-			-1
-			, 0.0,
-			c, //river_system_id
-			false
-		};
-		m_river_nodes_size++;
-
-		c++;
-	}
-
-	// -- grow rivers --	
-	int MAX_NODES_TO_PROCESS = 8;
-	bool added;
-	do
-	{
-		added = false;
-		if (nodes.empty())
-			break;
-
-		sorted_node_iterators.clear();
-		for (auto it = nodes.begin(); it != nodes.end(); ++it)
-			sorted_node_iterators.push_back(it);
-		std::sort(sorted_node_iterators.begin(), sorted_node_iterators.end(), compareBaseRiverNodeIterator);
-				
-		int processed_nodes = 0;
-		for (auto it = sorted_node_iterators.begin(); it != sorted_node_iterators.end(); ++it)//try to grow each node
-		{
-			const RiverGrowingNode & node = **it;
-			if (node.spring)
-				continue;
-
-			const EdgeGPU & edge = m_base_edges[node.edge];
-			const int v = node.tip_vertex;
-			VertexGPU & V = m_base_vertices[v];
-			const math::dvec3 pv(m_base_vattrib[v].position);
-			const math::dvec3 edgevec = pv - math::dvec3(m_base_vattrib[edge.v0 == v ? edge.v1 : edge.v0].position);
-			const PlanetData::Data local_data = m_planet->getInterpolatedModelData(pv);
-
-			bool edgefound = false;
-			adjacency.clear();
-			getAdjacentEdges(v, adjacency);
-
-			candidates.clear();
-			RiverGrowingNode candidateNode;
-
-			for (int k = 0; k < adjacency.size(); ++k)
-			{
-				const int e = adjacency[k];
-				const EdgeGPU & candidateEdge = m_base_edges[e];
-				const int w = (candidateEdge.v0 == v ? candidateEdge.v1 : candidateEdge.v0);
-
-				if (m_base_vertices[w].type != TYPE_CONTINENT)
-					continue;
-				if (m_base_triangles[candidateEdge.f0].type != TYPE_CONTINENT || m_base_triangles[candidateEdge.f1].type != TYPE_CONTINENT)
-					continue;
-
-				const math::dvec3 edgevec2 = math::dvec3(m_base_vattrib[w].position) - pv;
-				const double dotEdges = dot(edgevec, edgevec2);
-				if (dotEdges < 0.2)
-					continue;//check angle of edges to make proper rivers
-
-				// check that all edges adjacent to the candidate tip vertex are NOT themselves adjacent to a coast triangle (to prevent river springs near the coast).
-				tip_adjacency.clear();
-				getAdjacentEdges(w, tip_adjacency);
-				bool tip_adjacency_ok = true;
-				for (int t : tip_adjacency)
-				{
-					const EdgeGPU & tip_edge = m_base_edges[t];
-					int w2 = tip_edge.v0 == w ? tip_edge.v1 : tip_edge.v0;
-					if (m_base_vertices[w2].type == TYPE_SEA || m_base_triangles[tip_edge.f0].type != TYPE_CONTINENT || m_base_triangles[tip_edge.f1].type != TYPE_CONTINENT)
-					{
-						tip_adjacency_ok = false;
-						//edgefound = false;
-						break;
-					}
-				}
-				if (!tip_adjacency_ok)
-					continue;
-
-				edgefound = true;
-				RiverGrowingNode candidate;
-				candidate.edge = e;
-				candidate.tip_vertex = w;
-				double penalty = 100.0;
-#ifdef BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS
-				for (const MountainVertex & MV : mountains)
-				{
-					double distance = math::distance(math::dvec3(MV.position), math::dvec3(m_base_vattrib[w].position));
-					distance /= std::sqrt(MV.position.w);//the higher the mountain the more weight it has.
-					if (interest > distance)
-						interest = distance;
-				}
-#endif
-				double r = (double)(prng() % 65536) / 65535.0;
-				penalty *= 0.1 + 0.38*r + std::abs(math::dot(local_data.strain_direction, math::normalize(edgevec2)));// favor river direction orthogonal to local tectonic folding direction
-				r = (double)(prng() % 65536) / 65535.0;
-				//penalty *= 0.38*r + (1.0 - dotEdges);//favor non sinuosity
-				penalty *= (0.05 + m_base_vattrib[w].misc2.y);//favor non-plateaux to grow river locally 
-				penalty *= 1.0 - 0.99*math::smoothstep(-0.2, 0.1, m_base_vattrib[w].data.z - m_base_vattrib[v].data.z);//favor going "up hill"
-				candidate.choice_penalty = penalty;
-				candidates.push_back(candidate);				
-			}
-
-			if (!edgefound)
-			{// cannot grow river: terminate it and make a local spring.
-				(*it)->spring = true;
-				const double water_altitude = m_base_vattrib[v].position.w;
-				m_base_vattrib[v].data.w = water_altitude;
-				m_base_vattrib[v].flow.w = SPRING_FLOWVALUE;
-				m_base_vertices[v].type = TYPE_RIVER;				
-				continue;
-			}
-				
-			// sort candidates based on interest:
-			std::sort(candidates.begin(), candidates.end(), compareBaseRiverNode);
-			candidateNode = candidates[0];				
-			
-			bool branching = false;
-			RiverGrowingNode branch;
-			
-			const double proba_lerp = math::clamp(node.length_to_mouth / MAX_RIVER_LENGTH, 0.0, 1.0);
-			const int branching_proba = (int)math::mix(100.0, 0.0, std::sqrt(proba_lerp));
-
-			if (edgefound && prng() % 100 >= branching_proba && node.num_edges_to_mouth > 2.0)// sometimes make a branching river node (except for river mouth or so)
-			{
-				candidates.clear();
-
-				for (int k = 0; k < adjacency.size(); ++k)
-				{
-					const int e = adjacency[k];
-					if (e == candidateNode.edge)
-						continue;
-
-					const EdgeGPU & candidateEdge = m_base_edges[e];
-				
-					const int w = (candidateEdge.v0 == v ? candidateEdge.v1 : candidateEdge.v0);
-					if (m_base_vertices[w].type != TYPE_CONTINENT)
-						continue;
-					if (m_base_triangles[candidateEdge.f0].type != TYPE_CONTINENT || m_base_triangles[candidateEdge.f1].type != TYPE_CONTINENT)
-						continue;
-					const math::dvec3 edgevec2 = math::dvec3(m_base_vattrib[w].position) - pv;
-					if (dot(edgevec, edgevec2) < 0.0)
-						continue;//check angle of edges to make proper rivers
-
-					tip_adjacency.clear();
-					getAdjacentEdges(w, tip_adjacency);
-					bool tip_adjacency_ok = true;
-					for (int t : tip_adjacency)
-					{
-						const EdgeGPU & tip_edge = m_base_edges[t];
-						int w2 = tip_edge.v0 == w ? tip_edge.v1 : tip_edge.v0;
-						if (m_base_vertices[w2].type == TYPE_SEA || m_base_triangles[tip_edge.f0].type != TYPE_CONTINENT || m_base_triangles[tip_edge.f1].type != TYPE_CONTINENT)
-						{
-							tip_adjacency_ok = false;
-							break;
-						}
-					}
-					if (!tip_adjacency_ok)
-						continue;
-
-					branching = true;
-					branch.edge = e;
-					branch.tip_vertex = w;
-					double penalty = 100.0;
-					double r = (double)(prng() % 65536) / 65535.0;
-					penalty *= 0.1 + 0.38*r + std::abs(math::dot(local_data.strain_direction, math::normalize(edgevec2)));// favor river direction orthogonal to local tectonic folding direction
-					r = (double)(prng() % 65536) / 65535.0;
-					//penalty *= 0.38*r + (1.0 - dotEdges);//favor non sinuosity
-					penalty *= (0.05 + m_base_vattrib[w].misc2.y);//favor non-plateaux to grow river locally 
-					penalty *= 1.0 - 0.99*math::smoothstep(-0.2, 0.1, m_base_vattrib[w].data.z - m_base_vattrib[v].data.z);//favor going "up hill"
-					branch.choice_penalty = penalty;
-
-					candidates.push_back(branch);					
-				}
-
-				std::sort(candidates.begin(), candidates.end(), compareBaseRiverNode);
-				branch = candidates[0];
-			}
-
-			double nl = node.num_edges_to_mouth + 1.0;
-			const double prev_altitude = m_base_vattrib[v].position.w;//altitude of the previous river vertex			
-			const float prev_riverprofile = m_base_vattrib[v].misc2.w;
-
-			double MAX_SPRING_ALTITUDE;
-			const double Margin = 0.07;// 70 m
-			
-			if (edgefound)
-			{
-				added = true;
-
-				candidateNode.base_vertex = node.tip_vertex;
-				candidateNode.priority = node.priority;
-				
-				math::dvec4 va = m_base_vattrib[candidateNode.tip_vertex].position;
-
-				candidateNode.num_edges_to_mouth = nl;
-				candidateNode.spring = false;
-				candidateNode.length_to_mouth = node.length_to_mouth + math::distance(math::dvec3(va), pv);
-				candidateNode.normalized_tecto_altitude = (m_base_vattrib[candidateNode.tip_vertex].data.z - m_planet->seaLevelKm) / m_planet->maxAltitude;
-				
-				m_base_edges[candidateNode.edge].type = TYPE_RIVER;
-				m_base_vertices[candidateNode.tip_vertex].type = TYPE_RIVER;
-				
-				const double max_altitude = va.w;		
-				double MAXALT = max_altitude - Margin;
-				if (MAXALT < m_planet->seaLevelKm + 0.008)
-					MAXALT = max_altitude;
-				MAX_SPRING_ALTITUDE = std::max(0.7, 0.5 * (MAXALT - m_planet->seaLevelKm)) + m_planet->seaLevelKm;
-				double r = (double)(prng() % 65536) / 65535.0;
-				double altitude = prev_altitude + std::max(0.0, r*r * (max_altitude - m_planet->seaLevelKm) * 0.02);//max 200 m
-				if (node.num_edges_to_mouth == 1.0)
-					altitude = m_planet->seaLevelKm;
-				altitude = std::max(altitude, m_planet->seaLevelKm - 0.02);
-				
-				math::dvec3 p;
-				
-				if (altitude < MAXALT && altitude < MAX_SPRING_ALTITUDE && candidateNode.length_to_mouth < MAX_RIVER_LENGTH)
-				{//only grow the river if conditions are met
-					p = math::dvec3(va);
-					p = math::normalize(p) * (m_planet->radiusKm + altitude);
-					const double water_altitude = altitude;
-					m_base_vattrib[candidateNode.tip_vertex].position = math::dvec4(p, altitude);										
-					m_base_vattrib[candidateNode.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);								
-				}
-				else // else make the river spring and terminate
-				{
-					altitude = std::max(prev_altitude, std::min(MAX_SPRING_ALTITUDE, MAXALT));
-					p = math::dvec3(va);
-					p = math::normalize(p) * (m_planet->radiusKm + altitude);
-					const double water_altitude = altitude;
-					m_base_vattrib[candidateNode.tip_vertex].position = math::dvec4(p, altitude);
-					m_base_vattrib[candidateNode.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);
-					candidateNode.spring = true;
-				}				
-				m_base_vattrib[candidateNode.tip_vertex].flow = math::vec4(math::vec3(math::normalize(pv - p)), 0.0f);
-				m_base_vattrib[candidateNode.tip_vertex].misc2.w = prev_riverprofile + 0.05f * (float)(prng() % 65536) / 65535.0f;//random offset from previous vertex for river profile
-				m_base_vattrib[candidateNode.tip_vertex].padding_and_debug.w = (float)(candidateNode.length_to_mouth / MAX_RIVER_LENGTH);
-				
-				candidateNode.tip_river_node = m_river_nodes_size;
-				m_river_nodes[node.tip_river_node].nextnode1 = m_river_nodes_size;
-				m_river_nodes[node.tip_river_node].nextedge1 = candidateNode.edge;
-				m_river_nodes[m_river_nodes_size] = {
-					candidateNode.tip_vertex,
-					node.tip_river_node,
-					-1, -1,
-					-1, -1, 
-					0.0f,
-					-1,
-					-1.0f,
-					-1,
-					candidateNode.length_to_mouth,
-					m_river_nodes[node.tip_river_node].river_system_id,
-					false
-				};
-				m_river_nodes_size++;
-
-				**it = candidateNode;																	
-			}
-
-			if (branching)
-			{
-				math::dvec4 va = m_base_vattrib[branch.tip_vertex].position;
-				V.branch_count = 1;
-
-				branch.base_vertex = node.tip_vertex;
-				branch.length_to_mouth = node.length_to_mouth + math::distance(math::dvec3(va), pv);
-				branch.priority = node.priority;
-				
-				branch.num_edges_to_mouth = nl;
-				branch.spring = false;
-				branch.normalized_tecto_altitude = (m_base_vattrib[branch.tip_vertex].data.z - m_planet->seaLevelKm) / m_planet->maxAltitude;
-				m_base_edges[branch.edge].type = TYPE_RIVER;
-				m_base_vertices[branch.tip_vertex].type = TYPE_RIVER;
-								
-				const double max_altitude = va.w;
-				double MAXALT = max_altitude - Margin;
-				if (MAXALT < m_planet->seaLevelKm + 0.008)
-					MAXALT = max_altitude;
-				MAX_SPRING_ALTITUDE = std::max(0.7, 0.7 * (MAXALT - m_planet->seaLevelKm)) + m_planet->seaLevelKm;
-				double r = (double)(prng() % 65536) / 65535.0;
-				double altitude = prev_altitude + std::max(0.0, (1.0 - r) * (max_altitude - m_planet->seaLevelKm) * 0.02);//max 200m
-				if (node.num_edges_to_mouth == 1.0)
-					altitude = m_planet->seaLevelKm;
-				altitude = std::max(altitude, m_planet->seaLevelKm - 0.02);
-
-				math::dvec3 p;
-				
-				if (altitude < MAXALT && altitude < MAX_SPRING_ALTITUDE && branch.length_to_mouth < MAX_RIVER_LENGTH)
-				{//only grow the river if altitude stays below planet data
-					p = math::dvec3(va);
-					p = math::normalize(p) * (m_planet->radiusKm + altitude);
-					const double water_altitude = altitude;
-					m_base_vattrib[branch.tip_vertex].position = math::dvec4(p, altitude);
-					m_base_vattrib[branch.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);					
-				}
-				else // else make the river spring and terminate
-				{
-					altitude = std::max(prev_altitude, std::min(MAX_SPRING_ALTITUDE, MAXALT));
-					p = math::dvec3(va);
-					p = math::normalize(p) * (m_planet->radiusKm + altitude);
-					const double water_altitude = altitude;
-					m_base_vattrib[branch.tip_vertex].position = math::dvec4(p, altitude);
-					m_base_vattrib[branch.tip_vertex].data = math::dvec4(altitude, 0.0, max_altitude, water_altitude);
-					branch.spring = true;
-				}
-				m_base_vattrib[branch.tip_vertex].flow = math::vec4(math::vec3(math::normalize(pv - p)), 0.0);
-				m_base_vattrib[branch.tip_vertex].misc2.w = prev_riverprofile + 0.05f * (float)(prng() % 65536) / 65535.0f;//random offset from previous vertex for river profile
-				m_base_vattrib[branch.tip_vertex].padding_and_debug.w = (float)(branch.length_to_mouth / MAX_RIVER_LENGTH);
-				
-				branch.tip_river_node = m_river_nodes_size;
-				if (!branch.spring)
-				{					
-					branch_list.push_back(branch);
-				}
-
-				m_river_nodes[node.tip_river_node].nextnode2 = m_river_nodes_size;
-				m_river_nodes[node.tip_river_node].nextedge2 = branch.edge;
-				m_river_nodes[m_river_nodes_size] = {
-					branch.tip_vertex,
-					node.tip_river_node,
-					-1, -1,
-					-1, -1, 
-					0.0f,
-					-1,
-					-1.0f,
-					-1,
-					branch.length_to_mouth,
-					m_river_nodes[node.tip_river_node].river_system_id,
-					false
-
-				};
-				m_river_nodes_size++;
-			}
-
-			processed_nodes++;
-			if (processed_nodes >= MAX_NODES_TO_PROCESS)
-				break;
-		}
-
-		for (auto it = nodes.begin(); it != nodes.end(); ++it)
-		{
-			if (it->spring)//detect all spring nodes
-				to_delete.push_back(it);
-		}
-		for (int i = 0; i < to_delete.size(); ++i)
-			nodes.erase(to_delete[i]);//remove them from main list
-		to_delete.clear();
-
-		for (auto it = branch_list.begin(); it != branch_list.end(); ++it)
-			nodes.push_back(*it);//finally add all branch nodes to main list
-		branch_list.clear();
-
-		MAX_NODES_TO_PROCESS = (int)std::max(8.0, (double)nodes.size() / 8.0);
-	} 
-	while (true);
-}
-
-static int computeHortonStralher(RiverNode * array, int node)
-{//@returns the Hroton-Stralher number of this node
-
-	if (node == -1)
-		return 0;
-
-	int HS1 = computeHortonStralher(array, array[node].nextnode1);
-	int HS2 = computeHortonStralher(array, array[node].nextnode2);
-
-	if (HS1 == 0)
-	{
-		array[node].horton_stralher = 1;		
-	}
-	else 
-	{
-		if (HS2 == 0)
-		{
-			array[node].horton_stralher = HS1;
-		}
-		else if (HS1 == HS2)
-		{
-			array[node].horton_stralher = HS1 + 1;
-			array[node].asymetric_branching = false;
-		}
-		else
-		{
-			array[node].horton_stralher = HS1 > HS2 ? HS1 : HS2;
-			array[node].asymetric_branching = true;
-		}
-	}
-	
-	return array[node].horton_stralher;
-}
-
-static void computeRiverFlow(RiverNode * array, int node, float flow)
-{
-	RiverNode & n = array[node];
-	
-	if (n.nextnode1 == -1)
-		n.flow_value = SPRING_FLOWVALUE;
-	else 	
-	{
-		n.flow_value = flow;
-
-		if (n.nextnode2 == -1)
-		{
-			computeRiverFlow(array, n.nextnode1, flow);
-		}
-		else
-		{
-			if (n.asymetric_branching)
-			{
-				float w1 = (float)array[n.nextnode1].horton_stralher;
-				float w2 = (float)array[n.nextnode2].horton_stralher;
-				float f1 = flow * w1 / (w1 + w2);
-				float f2 = flow * w2 / (w1 + w2);
-				computeRiverFlow(array, n.nextnode1, f1);
-				computeRiverFlow(array, n.nextnode2, f2);
-			}
-			else {
-				computeRiverFlow(array, n.nextnode1, flow * 0.5f);
-				computeRiverFlow(array, n.nextnode2, flow * 0.5f);
-			}
-		}
-	}
-}
-
-double RenderablePlanet::assignWaterElevations(int node, double water_depth_at_mouth)
-{
-	if (node == -1)
-		return 0.0;
-
-	const RiverNode & n = m_river_nodes[node];
-	if (n.nextnode1 == -1)//river spring:
-	{
-		m_base_vattrib[n.vertex].data.w = m_base_vattrib[n.vertex].position.w;
-		return n.length_to_mouth;//return total river length
-	}
-
-	const double length1 = assignWaterElevations(n.nextnode1, water_depth_at_mouth);
-	const double length2 = assignWaterElevations(n.nextnode2, water_depth_at_mouth);
-	const double riverlength = std::max(length1, length2);
-	
-	double t = n.length_to_mouth / riverlength;
-	t *= t;
-	const double water_depth = water_depth_at_mouth * (1.0 - 0.9 * t * t);
-	m_base_vattrib[n.vertex].data.w = m_base_vattrib[n.vertex].position.w + water_depth;
-
-	return riverlength;
-}
-
-void RenderablePlanet::postprocessBaseRiverNetwork()
-{
-	// --- compute Horton-Stralher number ---
-	int max_hs = 0;	
-	for (auto it = m_rivers.begin(); it != m_rivers.end(); ++it)
-	{
-		int mouth = *it;
-
-		int hs = computeHortonStralher(m_river_nodes, mouth);
-		if (hs > max_hs)
-			max_hs = hs;			
-	}
-		
-	double max_len = 0.0;
-	std::vector<double> maxriverlength(m_rivers.size(), 0.0);
-	for (int i=0; i < m_river_nodes_size; ++i)
-		if (m_river_nodes[i].nextnode1 == -1)
-		{
-			if (m_river_nodes[i].length_to_mouth > max_len)
-				max_len = m_river_nodes[i].length_to_mouth;
-
-			if (m_river_nodes[i].length_to_mouth > maxriverlength[m_river_nodes[i].river_system_id])
-				maxriverlength[m_river_nodes[i].river_system_id] = m_river_nodes[i].length_to_mouth;
-		}
-	std::cout << "Max river length = " << max_len << " km" << std::endl;
-
-	// --- prune un-grown river nodes ---
-	std::mt19937 prng;
-
-	const double river_length_threshold = 10.0;//km
-	for (int i = 0; i < m_river_nodes_size; ++i)
-	{
-		RiverNode & n = m_river_nodes[i];
-		if (maxriverlength[n.river_system_id] > river_length_threshold)
-		{
-			prng.seed(n.river_system_id * 33875999);
-			float river_id = (float)(prng() % 65536);
-			m_base_vattrib[n.vertex].padding_and_debug.w = river_id;
-			continue;
-		}
-
-		n.disabled = true;
-
-		m_base_vertices[n.vertex].type = TYPE_CONTINENT;
-		VertexAttributesGPU & attrib = m_base_vattrib[n.vertex];
-		math::dvec3 pos = math::normalize(math::dvec3(attrib.position));
-		attrib.position = math::dvec4((attrib.data.z + m_planet->radiusKm) * pos, attrib.data.z);
-		attrib.data = math::dvec4(attrib.data.z, 50.0, attrib.data.z, m_planet->seaLevelKm);
-
-		if (n.nextedge1 != -1)
-			m_base_edges[n.nextedge1].type = TYPE_NONE;
-		if (n.nextedge2 != -1)
-			m_base_edges[n.nextedge2].type = TYPE_NONE;
-	}
-	
-	// Compute river flow, output Horton-Strahler data:
-	float avg_hs = 0.0f;
-	float final_num_rivers = 0.0f;
-	for (auto it = m_rivers.begin(); it != m_rivers.end(); ++it)
-	{
-		int mouth = *it;
-
-		if (m_river_nodes[mouth].disabled)
-			continue;
-		final_num_rivers += 1.0f;
-
-		int hs = m_river_nodes[mouth].horton_stralher;
-		avg_hs += (float)hs;
-
-		float flow = std::sqrt(maxriverlength[m_river_nodes[mouth].river_system_id] / max_len);
-		computeRiverFlow(m_river_nodes, mouth, flow);		
-	}
-	avg_hs /= final_num_rivers;
-	std::cout << "Final river systems count = " << (int)final_num_rivers << " (out of total " << m_rivers.size() << " candidate systems)." << std::endl;
-	std::cout << "Horton-Strahler: max " << max_hs << ", average " << avg_hs << "." << std::endl;
-
-	for (int i = 0; i < m_river_nodes_size; ++i)
-	{
-		RiverNode & n = m_river_nodes[i];
-		if (n.disabled)
-			continue;
-
-		if (m_base_vertices[n.vertex].type == TYPE_RIVER)
-			m_base_vattrib[n.vertex].flow.w = n.flow_value;
-	}
-
-	// Assign water elevations:
-	for (auto it = m_rivers.begin(); it != m_rivers.end(); ++it)
-	{
-		int mouth = *it;
-		if (m_river_nodes[mouth].disabled)
-			continue;
-
-		int nextmouth = m_river_nodes[mouth].nextnode1;
-				
-		const double water_depth = m_planet->seaLevelKm - m_base_vattrib[m_river_nodes[nextmouth].vertex].position.w;
-
-		assignWaterElevations(nextmouth, water_depth);
-	}
-}
-
-void RenderablePlanet::getAdjacentEdges(int vertex_index, std::vector<int> & adjacency) const
-{
-	const VertexGPU & vertex = m_base_vertices[vertex_index];
-	for (int k = 0; k < 4; ++k)
-	{
-		if (vertex.faces_0[k] == -1)
-			continue;
-		const TriangleGPU & T = m_base_triangles[vertex.faces_0[k]];
-		
-		const EdgeGPU & E0 = m_base_edges[T.e0];
-		if (E0.v0 == vertex_index || E0.v1 == vertex_index)
-			adjacency.push_back(T.e0);
-		
-		const EdgeGPU & E1 = m_base_edges[T.e1];
-		if (E1.v0 == vertex_index || E1.v1 == vertex_index)
-			adjacency.push_back(T.e1);
-		
-		const EdgeGPU & E2 = m_base_edges[T.e2];
-		if (E2.v0 == vertex_index || E2.v1 == vertex_index)
-			adjacency.push_back(T.e2);
-	}
-	for (int k = 0; k < 4; ++k)
-	{
-		if (vertex.faces_1[k] == -1)
-			continue;
-		const TriangleGPU & T = m_base_triangles[vertex.faces_1[k]];
-
-		const EdgeGPU & E0 = m_base_edges[T.e0];
-		if (E0.v0 == vertex_index || E0.v1 == vertex_index)
-			adjacency.push_back(T.e0);
-
-		const EdgeGPU & E1 = m_base_edges[T.e1];
-		if (E1.v0 == vertex_index || E1.v1 == vertex_index)
-			adjacency.push_back(T.e1);
-
-		const EdgeGPU & E2 = m_base_edges[T.e2];
-		if (E2.v0 == vertex_index || E2.v1 == vertex_index)
-			adjacency.push_back(T.e2);
-	}
-}
-
 void RenderablePlanet::bindBuffers() 
 {
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_edge_buffer);
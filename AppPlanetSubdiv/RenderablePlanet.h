@@ -1,6 +1,7 @@
 #pragma once
 
 #include "PlanetData.h"
+#include "PlanetBaseBuilder.h"
 #include "shader.h"
 #include "tool.h"
 #include "glversion.h"
@@ -11,6 +12,10 @@
 
 // ---- options ----
 //#define SUBDIVISION_TIMER_QUERIES 1		// if defined then timer queries are launched for each subdivision, note that it stalls the gPU.
+//#define BASE_MESH_ADAPTIVE_DENSITY	160.0	// if defined then the base mesh is sampled sparsely in open ocean, up to this edge length in km (see PlanetBaseBuilder::setAdaptiveDensity)
+//#define BASE_MESH_SDT_CACHE			"../assets/delaunay/"	// if defined then the base mesh triangulation is cached in this directory and reused across runs (see PlanetBaseBuilder::setTriangulationCache)
+//#define BASE_PLANET_CACHE				"../assets/baked/"	// if defined then the whole base planet (base mesh and river network) is cached in this directory, keyed by a hash of its inputs (see PlanetBaseBuilder::setBakeCache)
+//#define BASE_MESH_PREVIEW_LATTICE			// if defined then the base mesh is sampled with a jittered lattice instead of Poisson disks (faster start-up, for previews)
 
 
 
@@ -18,8 +23,6 @@
 
 #define LOAD_NOISE_TEXTURE	
 
-//#define BASE_RIVERS_LOOKUP_TECTONIC_ELEVATIONS				// if defined then lookup tectonic max elevations for growing the base river network (this is very costly!)
-
 #define RENDER_SCALE						1000.0		// 1 opengl unit is 1000 km			
 #define TARGET_EDGE_SIZE_PIXELS				8.0			// screenspace error tolerance on a triangle edge, in pixels
 #define MAX_TESSELLATION_LOD				16			// this is < 1 m surface resolution for 50 km edge length at GPU LOD 0
@@ -28,85 +31,6 @@
 
 #define PLANET_MAX_TRIANGLES				(20*1024*1024)
 
-#define TYPE_NONE							0	
-#define TYPE_SEA							1		
-#define TYPE_CONTINENT						2
-#define TYPE_RIVER							3
-#define TYPE_COAST							4
-#define TYPE_RIDGE							5
-#define TYPE_OCTAHEDRON_EDGE				16
-
-#define SPRING_FLOWVALUE					0.01f		// value of the flow at spring locations (slightly above zero)
-
-
-struct alignas(16) EdgeGPU
-{
-	/// indexes of the two vertices
-	int v0, v1;
-	/// index of the middle split vertex
-	int vm = -1;
-	/// LSB to MSB: first byte = split status (0: not split, 1: ghost split, 2: split), second byte = boolean (ghost edge or not), third byte = subdivision level
-	unsigned int status = 0;
-	/// indexes of the two subedges if split
-	int child0 = -1, child1 = -1;	
-	/// indexes of the two adjacent faces
-	int f0, f1;
-	/// Type
-	unsigned int type = TYPE_NONE;
-	
-	int padding[3];
-};
-
-struct alignas(16) VertexGPU
-{
-	/// first list of indexes of incident faces (or -1 if none)
-	int faces_0[4] = { -1, -1, -1, -1 };
-	/// second list of indexes of incident faces (or -1 if none)
-	int faces_1[4] = { -1, -1, -1, -1 };
-	/// PRNG seed
-	unsigned int seed;
-	/// boolean = ghost or not ghost vertex
-	unsigned int status = 0;
-	/// Type : 0 none, 1 sea, 2 continent, 3 river
-	unsigned int type = TYPE_NONE;
-	/// number of river branches at that vertex (0 or 1) not counting the main river flow, ie., this is the number of tributaries at that vertex.
-	unsigned int branch_count = 0;
-	
-	/// some references (prim0 is used as a containing triangle index, for water animation ; prim1 is unused ; prim2 is a vertex reference used for lakes]
-	int prim0 = -1, prim1 = -1, prim2 = -1;
-	int padding1;
-
-	//math::ivec4 padding2;
-};
-
-struct alignas(16) TriangleGPU
-{
-	/// indexes of the three edges (they appear in the right winding order (RH rule)).
-	int e0, e1, e2;
-	/// normal to the triangle
-	float normal_x, normal_y, normal_z;
-	/// LSB to MSB : byte 0 = boolean (split 1 or not 0), byte 2 = lod
-	unsigned int status = 0;
-	/// Type
-	unsigned int type = TYPE_NONE;
-};
-
-struct alignas(32) VertexAttributesGPU
-{
-	/// xyz = 3D position, w = ground altitude
-	math::dvec4 position;
-	/// x = nearest river altitude, y = distance to nearest river, z = tectonic altitude (=max altitude), w = water altitude // - note we need double precision for water altitudes essentially.
-	math::dvec4 data;
-	/// xyz = water flow direction normalized, w = normalized flow quantity
-	math::vec4 flow;	
-	/// x = nearest ravin altitude, y = distance to nearest ravin, z = hilly landscape [0, 1], w = ravin flow value in [0, 1] (unused for now)
-	math::vec4 misc1;
-	/// x = crust age in Ma, y = plateau presence in [0, 1], z = desert/wet biome (1 is desert,0 is wet), w = river profile indirection
-	math::vec4 misc2;
-	//
-	math::vec4 padding_and_debug;
-};
-
 struct alignas(32) WaterVertexAttributesGPU
 {
 	/// xyz = 3D position, w = average water altitude (before wave displacement)
@@ -123,44 +47,6 @@ struct alignas(32) WaterVertexAttributesGPU
 };
 
 
-/// internal use only
-struct RiverGrowingNode
-{
-	double num_edges_to_mouth;
-	//double branching_level = 0.0;
-	double length_to_mouth = 0.0;
-	double target_river_length;//desired river length (max length)	
-	double choice_penalty;
-	double normalized_tecto_altitude;
-	double priority;
-	float max_flow_value;//unused ?
-	int edge;
-	int base_vertex;
-	int tip_river_node;
-	int tip_vertex;
-	bool spring;
-	bool full_grown;//unused ?
-};
-
-struct RiverNode
-{
-	int vertex = -1;
-	int prevnode = -1;
-	int nextnode1 = -1;
-	int nextnode2 = -1;
-	int nextedge1 = -1;
-	int nextedge2 = -1;
-	float flow_value = 0.0f;
-	int horton_stralher = -1;
-	float rosgen_type = -1.0f;	
-	int asymetric_branching = -1;	
-	double length_to_mouth = 0.0;
-	int river_system_id = -1;//the river system this nodes belongs to
-	bool disabled = false;//true if this river node belongs to a river system that has been discarded.
-};
-
-
-
 class RenderablePlanet : protected Q_OPENGL_FUNCS
 {
 
@@ -201,16 +87,6 @@ private:
 	
 	bool doTessellationPass(int lod);
 	
-	void makePoissonDelaunayBaseMesh();
-	
-	void createBaseRiverNetwork();
-	void createAllRiverMouth(std::vector<RiverGrowingNode> & nodes);
-	void postprocessBaseRiverNetwork();
-	bool isTriangleSeaCoast(int triangle_index) const;
-	void getAdjacentEdges(int vertex_index, std::vector<int> & adjacency) const;
-	
-	double assignWaterElevations(int node, double water_depth_at_mouth);
-
 	void bindBuffers();
 	void renderDebug(const math::dvec3 & cameraPosition, const math::dmat4 & view, const math::dmat4 & projection);
 	
@@ -231,10 +107,6 @@ private:
 	std::vector<TriangleGPU> m_base_triangles;
 	std::vector<VertexAttributesGPU> m_base_vattrib;
 
-	RiverNode * m_river_nodes = nullptr;//storage for all river nodes
-	std::list<int> m_rivers;//indexes of the river mouthes into m_river_nodes
-	int m_river_nodes_size, m_river_nodes_max_size;
-	
 	Shader* m_compute_edgesplit = nullptr, * m_compute_edgesplit_simple = nullptr;// *m_compute_edgesplit_norelief = nullptr, * m_compute_edgesplit_puremidpoint = nullptr;
 	Shader * m_compute_ghostmarking = nullptr;
 	Shader* m_compute_ghostsplit = nullptr;// *m_compute_ghostsplit_puremidpoint = nullptr;
@@ -249,8 +121,6 @@ private:
 	math::dvec3 m_sun_direction = math::dvec3(1.0, 0.0, 0.0);
 	math::dvec3 m_camera_position_km;
 	double m_camera_nearplane_km, m_camera_farplane_km, m_camera_fov;
-	double m_base_edge_length;
-	double MAX_RIVER_LENGTH;
 	int m_viewheight, m_viewwidth;
 
 	GLuint m_pos_vbo = 0, m_ibo = 0, m_vao = 0;
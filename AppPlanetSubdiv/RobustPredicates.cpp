@@ -0,0 +1,132 @@
+#include "RobustPredicates.h"
+
+
+
+namespace predicates
+{
+	// An expansion is a sum of non-overlapping doubles stored by increasing magnitude, its sign is the sign of its last component.
+
+	/** x + y = a + b exactly. */
+	static inline void twoSum(double a, double b, double & x, double & y)
+	{
+		x = a + b;
+		const double bvirt = x - a;
+		const double avirt = x - bvirt;
+		y = (a - avirt) + (b - bvirt);
+	}
+
+	/** x + y = a * b exactly. */
+	static inline void twoProduct(double a, double b, double & x, double & y)
+	{
+		x = a * b;
+		y = std::fma(a, b, -x);
+	}
+
+	/** h = e + b, returns the length of h (at most elen + 1). */
+	static int growExpansion(int elen, const double * e, double b, double * h)
+	{
+		double Q = b;
+		int hlen = 0;
+		for (int i = 0; i < elen; ++i)
+		{
+			double Qnew, hh;
+			twoSum(Q, e[i], Qnew, hh);
+			Q = Qnew;
+			if (hh != 0.0)
+				h[hlen++] = hh;
+		}
+		if (Q != 0.0 || hlen == 0)
+			h[hlen++] = Q;
+		return hlen;
+	}
+
+	/** h = e + f, returns the length of h (at most elen + flen). h must not alias e or f. */
+	static int sumExpansion(int elen, const double * e, int flen, const double * f, double * h)
+	{
+		double tmp[2][192];
+		const double * src = e;
+		int len = elen;
+		for (int i = 0; i < flen; ++i)
+		{
+			double * dst = (i == flen - 1) ? h : tmp[i & 1];
+			len = growExpansion(len, src, f[i], dst);
+			src = dst;
+		}
+		if (flen == 0)
+			for (int i = 0; i < elen; ++i)
+				h[i] = e[i];
+		return len;
+	}
+
+	/** h = b * e, returns the length of h (at most 2 * elen). */
+	static int scaleExpansion(int elen, const double * e, double b, double * h)
+	{
+		double Q, hh;
+		int hlen = 0;
+		twoProduct(e[0], b, Q, hh);
+		if (hh != 0.0)
+			h[hlen++] = hh;
+		for (int i = 1; i < elen; ++i)
+		{
+			double product1, product0, sum;
+			twoProduct(e[i], b, product1, product0);
+			twoSum(Q, product0, sum, hh);
+			if (hh != 0.0)
+				h[hlen++] = hh;
+			twoSum(product1, sum, Q, hh);
+			if (hh != 0.0)
+				h[hlen++] = hh;
+		}
+		if (Q != 0.0 || hlen == 0)
+			h[hlen++] = Q;
+		return hlen;
+	}
+
+	/** e = px * qy - qx * py exactly, returns the length of e (at most 4). */
+	static int minor2(const math::dvec3 & p, const math::dvec3 & q, double * e)
+	{
+		double pxqy[2], qxpy[2];
+		twoProduct(p.x, q.y, pxqy[1], pxqy[0]);
+		twoProduct(-q.x, p.y, qxpy[1], qxpy[0]);
+		return sumExpansion(2, pxqy, 2, qxpy, e);
+	}
+
+	double orient3dExact(const math::dvec3 & a, const math::dvec3 & b, const math::dvec3 & c, const math::dvec3 & d)
+	{
+		// det[a - d, b - d, c - d] = az * |b c d| - bz * |c d a| + cz * |d a b| - dz * |a b c| (cofactor expansion of the 4x4 homogeneous determinant)
+		double ab[4], bc[4], cd[4], da[4], ac[4], bd[4];
+		const int ablen = minor2(a, b, ab);
+		const int bclen = minor2(b, c, bc);
+		const int cdlen = minor2(c, d, cd);
+		const int dalen = minor2(d, a, da);
+		const int aclen = minor2(a, c, ac);
+		const int bdlen = minor2(b, d, bd);
+
+		double temp8[8], cda[12], dab[12], abc[12], bcd[12];
+		int templen = sumExpansion(cdlen, cd, dalen, da, temp8);
+		const int cdalen = sumExpansion(templen, temp8, aclen, ac, cda);
+		templen = sumExpansion(dalen, da, ablen, ab, temp8);
+		const int dablen = sumExpansion(templen, temp8, bdlen, bd, dab);
+		for (int i = 0; i < bdlen; ++i)
+			bd[i] = -bd[i];
+		for (int i = 0; i < aclen; ++i)
+			ac[i] = -ac[i];
+		templen = sumExpansion(ablen, ab, bclen, bc, temp8);
+		const int abclen = sumExpansion(templen, temp8, aclen, ac, abc);
+		templen = sumExpansion(bclen, bc, cdlen, cd, temp8);
+		const int bcdlen = sumExpansion(templen, temp8, bdlen, bd, bcd);
+
+		double adet[24], bdet[24], cdet[24], ddet[24];
+		const int alen = scaleExpansion(bcdlen, bcd, a.z, adet);
+		const int blen = scaleExpansion(cdalen, cda, -b.z, bdet);
+		const int clen = scaleExpansion(dablen, dab, c.z, cdet);
+		const int dlen = scaleExpansion(abclen, abc, -d.z, ddet);
+
+		double abdet[48], cddet[48], det[96];
+		const int abdetlen = sumExpansion(alen, adet, blen, bdet, abdet);
+		const int cddetlen = sumExpansion(clen, cdet, dlen, ddet, cddet);
+		const int detlen = sumExpansion(abdetlen, abdet, cddetlen, cddet, det);
+
+		return -det[detlen - 1];// same sign convention as orient3d
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "tool.h"
+
+#include <cmath>
+
+
+/**
+ * Robust geometric predicates, after J. R. Shewchuk, "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric Predicates" (1997).
+ * A floating-point evaluation is returned whenever its error bound certifies its sign, otherwise the determinant is evaluated exactly with expansion arithmetic.
+ * On the sphere both the in-circle test (Delaunay condition) and the side-of-great-circle test (point location) reduce to orient3d.
+ */
+namespace predicates
+{
+	/** Exact evaluation of orient3d (expansion arithmetic), only its sign is meaningful. Called by orient3d when the floating-point filter fails. */
+	double orient3dExact(const math::dvec3 & a, const math::dvec3 & b, const math::dvec3 & c, const math::dvec3 & d);
+
+	/**
+	 * @returns A positive value if d lies above the plane through a, b and c (ie. a, b, c appear counterclockwise seen from d), a negative value if below, zero if the four points are coplanar.
+	 * The sign is exact, the magnitude approximates dot(cross(b - a, c - a), d - a).
+	 */
+	inline double orient3d(const math::dvec3 & a, const math::dvec3 & b, const math::dvec3 & c, const math::dvec3 & d)
+	{
+		// error bound of the floating-point evaluation below (Shewchuk's o3derrboundA, epsilon = 2^-53)
+		constexpr double EPSILON = 1.1102230246251565e-16;
+		constexpr double ERRBOUND = (7.0 + 56.0 * EPSILON) * EPSILON;
+
+		const double adx = a.x - d.x, bdx = b.x - d.x, cdx = c.x - d.x;
+		const double ady = a.y - d.y, bdy = b.y - d.y, cdy = c.y - d.y;
+		const double adz = a.z - d.z, bdz = b.z - d.z, cdz = c.z - d.z;
+
+		const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+		const double cdxady = cdx * ady, adxcdy = adx * cdy;
+		const double adxbdy = adx * bdy, bdxady = bdx * ady;
+
+		const double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+		const double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * std::fabs(adz)
+			+ (std::fabs(cdxady) + std::fabs(adxcdy)) * std::fabs(bdz)
+			+ (std::fabs(adxbdy) + std::fabs(bdxady)) * std::fabs(cdz);
+		const double errbound = ERRBOUND * permanent;
+		if (det > errbound || -det > errbound)
+			return -det;// det = det[a - d, b - d, c - d] is positive when d lies below the plane
+
+		return orient3dExact(a, b, c, d);
+	}
+}
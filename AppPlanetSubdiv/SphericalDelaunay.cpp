@@ -1,8 +1,11 @@
 #include "SphericalDelaunay.h"
 
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <unordered_map>
+#include <cstring>
 #include <fstream>
+#include <thread>
 
 
 bool SphericalTriangle::containsPoint(const SphericalVertex * vertices, const math::dvec3 & sphere_center, const math::dvec3 & v) const
@@ -13,20 +16,11 @@ bool SphericalTriangle::containsPoint(const SphericalVertex * vertices, const ma
 	const math::dvec3 & v1 = vertices[vertex[1]].coordinates;
 	const math::dvec3 & v2 = vertices[vertex[2]].coordinates;
 
-	// compute the three normals:
-	math::dvec3 O0 = math::normalize(v0 -sphere_center);
-	math::dvec3 O1 = math::normalize(v1 -sphere_center);
-	math::dvec3 O2 = math::normalize(v2 -sphere_center);
-
-	math::dvec3 n0 = math::cross(O1, O2); // cross product
-	math::dvec3 n1 = math::cross(O2, O0); // cross product
-	math::dvec3 n2 = math::cross(O0, O1); // cross product
-
-	// Test:
-	bool hemisphereTest = math::dot(math::normalize(v - sphere_center), O0) > 0.0;
-	bool test0 = math::dot(math::normalize(v - v1), n0) >= EPSILON_TEST;
-	bool test1 = math::dot(math::normalize(v - v2), n1) >= EPSILON_TEST;
-	bool test2 = math::dot(math::normalize(v - v0), n2) >= EPSILON_TEST;
+	// Test (v must lie on the inner side of the three planes through the sphere center and an edge):
+	bool hemisphereTest = math::dot(v - sphere_center, v0 - sphere_center) > 0.0;
+	bool test0 = predicates::orient3d(sphere_center, v1, v2, v) >= 0.0;
+	bool test1 = predicates::orient3d(sphere_center, v2, v0, v) >= 0.0;
+	bool test2 = predicates::orient3d(sphere_center, v0, v1, v) >= 0.0;
 	return hemisphereTest && test0 && test1 && test2;
 	
 	/*const math::dvec3 & v0 = vertices[vertex[0]].coordinates;
@@ -93,10 +87,8 @@ SphericalDelaunay::SphericalDelaunay(double sphere_radius, unsigned int reserve)
 	if (reserve == 0)
 		reserve = 8;
 
-	m_vertices = new SphericalVertex[reserve];
-	m_triangles = new SphericalTriangle[4 * reserve];
-	m_triangle_capacity = 4 * reserve;
-	m_vertex_capacity = reserve;
+	reserveVertices(reserve);
+	reserveTriangles(4 * reserve);
 
 	m_vertices_freeslots.reserve(64);
 	m_triangles_freeslots.reserve(64);
@@ -104,35 +96,53 @@ SphericalDelaunay::SphericalDelaunay(double sphere_radius, unsigned int reserve)
 	makeBaseOctahedron();
 }
 
-SphericalDelaunay::SphericalDelaunay(double sphere_radius, double poisson_radius)
+SphericalDelaunay::SphericalDelaunay(double sphere_radius, double poisson_radius, SphereSamplingMethod method, const PoissonSphereSampling::RadiusFunction & radius_function)
 	: m_vertex_index(0), m_triangle_index(0)
 	, m_num_vertices(0), m_num_triangles(0)
 	, m_sphere_center(0.0, 0.0, 0.0), m_sphere_radius(sphere_radius)
 {
-	PoissonSphereSampling sampler;
-	sampler.sample(m_sphere_radius, poisson_radius);
-	std::vector<math::dvec3> samples = sampler.getSamples();
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<math::dvec3> samples;
+	if (method == SphereSamplingMethod::LATTICE)
+	{
+		if (radius_function)
+			std::cout << "SphericalDelaunay:: the lattice sampling is uniform, the radius function is ignored." << std::endl;
+		LatticeSphereSampling sampler;
+		sampler.sample(m_sphere_radius, poisson_radius);
+		samples.swap(sampler.getSamples());
+	}
+	else
+	{
+		PoissonSphereSampling sampler;
+		sampler.sampleParallel(m_sphere_radius, poisson_radius, 13337, 0, radius_function);
+		samples.swap(sampler.getSamples());
+	}
 	std::vector<math::dvec3> samples_without_octahedron(samples.begin() + 6, samples.end());
+	tool::recordStage(m_time_data.sampling, start, samples.size());
 
 	int reserve = samples.size() +2;
-	m_vertices = new SphericalVertex[reserve];
-	m_triangles = new SphericalTriangle[4 * reserve];
-	m_triangle_capacity = 4 * reserve;
-	m_vertex_capacity = reserve;
+	reserveVertices(reserve);
+	reserveTriangles(4 * reserve);
 
 	m_vertices_freeslots.reserve(64);
 	m_triangles_freeslots.reserve(64);
 	
+#ifdef SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION
 	// outline:
 	// 1 - do a naive triangulation (just find the host triangle and split)
 	// 2 - make a Lawson pass (edge flips)
+	// 3 - insert the remaining vertices incrementally (with edge flips)
+	start = std::chrono::high_resolution_clock::now();
+	sortInsertionOrder(samples_without_octahedron, 13337);
 	makeBaseOctahedron();
 	const int naive_count = std::min((int)samples_without_octahedron.size() - 1, 10000);
 	std::vector<math::dvec3> samples_naive(samples_without_octahedron.begin(), samples_without_octahedron.begin() + naive_count);
 	createNaiveTriangulation(samples_naive);
 	applyLawson();
+	tool::recordStage(m_time_data.naive_lawson, start, naive_count);
 
 	std::cout << "Incremental delaunay insertion ... " << std::endl;
+	start = std::chrono::high_resolution_clock::now();
 	const int count = samples_without_octahedron.size() - naive_count;
 	auto it = samples_without_octahedron.begin() + naive_count;
 	for (int i = 0; i < count; ++i)
@@ -142,33 +152,42 @@ SphericalDelaunay::SphericalDelaunay(double sphere_radius, double poisson_radius
 			//std::cout << i << "/" << count << " ";
 		it++;
 	}
+	tool::recordStage(m_time_data.insertion, start, count);
 	std::cout << "\n" << std::endl;
+#else
+	// the spherical Delaunay triangulation is the convex hull of the samples
+	std::cout << "Convex hull delaunay construction ... " << std::endl;
+	start = std::chrono::high_resolution_clock::now();
+	sortInsertionOrder(samples_without_octahedron, 13337);
+	makeBaseOctahedron();
+	insertVerticesParallel(samples_without_octahedron);
+	sortTriangles();
+	tool::recordStage(m_time_data.insertion, start, samples_without_octahedron.size());
+#endif
 }
 
-/*SphericalDelaunay::SphericalDelaunay(const std::vector<math::dvec3> & vertices, double sphere_radius)
-	: SphericalDelaunay(sphere_radius, vertices.size() + 1)
+SphericalDelaunay::SphericalDelaunay(const std::vector<math::dvec3> & vertices, double sphere_radius)
+	: SphericalDelaunay(sphere_radius, (unsigned int)vertices.size() + 6)
 {
-	// outline:
-	// 1 - do a naive triangulation (just find the host triangle and split)
-	// 2 - make a Lawson pass (edge flips)
-	createNaiveTriangulation(vertices);
-	applyLawson();
-}*/
+	std::vector<math::dvec3> sorted(vertices);
+	sortInsertionOrder(sorted, 13337);
+	insertVerticesParallel(sorted);
+	sortTriangles();
+}
 
 SphericalDelaunay::SphericalDelaunay(const SphericalDelaunay & sdt)
 {	
 	m_sphere_center = sdt.m_sphere_center;
 	m_sphere_radius = sdt.m_sphere_radius;	
+	m_time_data = sdt.m_time_data;
 
 	if (sdt.m_num_triangles > 0)
 	{
 		m_num_triangles = sdt.m_num_triangles;
 		m_triangle_id_count = sdt.m_triangle_id_count;
 		m_triangle_index = sdt.m_triangle_index;
-		m_triangle_capacity = sdt.m_triangle_capacity;
-		m_triangles = new SphericalTriangle[m_triangle_capacity];
-		for (int i = 0; i < m_triangle_index; ++i)
-			m_triangles[i] = sdt.m_triangles[i];			
+		reserveTriangles(sdt.m_triangle_capacity);
+		std::copy(sdt.m_triangles, sdt.m_triangles + m_triangle_index, m_triangles);			
 		m_triangles_freeslots = std::vector<int>(sdt.m_triangles_freeslots.begin(), sdt.m_triangles_freeslots.end());
 	}
 	if (sdt.m_num_vertices > 0)
@@ -176,28 +195,29 @@ SphericalDelaunay::SphericalDelaunay(const SphericalDelaunay & sdt)
 		m_num_vertices = sdt.m_num_vertices;
 		m_vertex_id_count = sdt.m_vertex_id_count;
 		m_vertex_index = sdt.m_vertex_index;
-		m_vertex_capacity = sdt.m_vertex_capacity;
-		m_vertices = new SphericalVertex[m_vertex_capacity];
-		for (int i = 0; i < m_vertex_index; ++i)
-			m_vertices[i] = sdt.m_vertices[i];
+		reserveVertices(sdt.m_vertex_capacity);
+		std::copy(sdt.m_vertices, sdt.m_vertices + m_vertex_index, m_vertices);
 		m_vertices_freeslots = std::vector<int>(sdt.m_vertices_freeslots.begin(), sdt.m_vertices_freeslots.end());
 	}
 }
 
 SphericalDelaunay & SphericalDelaunay::operator=(const SphericalDelaunay & sdt)
 {
+	if (this == &sdt)
+		return *this;
+	cleanup();
+
 	m_sphere_center = sdt.m_sphere_center;
 	m_sphere_radius = sdt.m_sphere_radius;
+	m_time_data = sdt.m_time_data;
 
 	if (sdt.m_num_triangles > 0)
 	{
 		m_num_triangles = sdt.m_num_triangles;
 		m_triangle_id_count = sdt.m_triangle_id_count;
 		m_triangle_index = sdt.m_triangle_index;
-		m_triangle_capacity = sdt.m_triangle_capacity;
-		m_triangles = new SphericalTriangle[m_triangle_capacity];
-		for (int i = 0; i < m_triangle_index; ++i)
-			m_triangles[i] = sdt.m_triangles[i];
+		reserveTriangles(sdt.m_triangle_capacity);
+		std::copy(sdt.m_triangles, sdt.m_triangles + m_triangle_index, m_triangles);
 		m_triangles_freeslots = std::vector<int>(sdt.m_triangles_freeslots.begin(), sdt.m_triangles_freeslots.end());
 	}
 	if (sdt.m_num_vertices > 0)
@@ -205,10 +225,8 @@ SphericalDelaunay & SphericalDelaunay::operator=(const SphericalDelaunay & sdt)
 		m_num_vertices = sdt.m_num_vertices;
 		m_vertex_id_count = sdt.m_vertex_id_count;
 		m_vertex_index = sdt.m_vertex_index;
-		m_vertex_capacity = sdt.m_vertex_capacity;
-		m_vertices = new SphericalVertex[m_vertex_capacity];
-		for (int i = 0; i < m_vertex_index; ++i)
-			m_vertices[i] = sdt.m_vertices[i];
+		reserveVertices(sdt.m_vertex_capacity);
+		std::copy(sdt.m_vertices, sdt.m_vertices + m_vertex_index, m_vertices);
 		m_vertices_freeslots = std::vector<int>(sdt.m_vertices_freeslots.begin(), sdt.m_vertices_freeslots.end());
 	}
 
@@ -217,9 +235,11 @@ SphericalDelaunay & SphericalDelaunay::operator=(const SphericalDelaunay & sdt)
 
 void SphericalDelaunay::cleanup()
 {
-	delete[] m_vertices;
+	delete m_mapped_file;// the arrays may point into the mapped file
+	m_mapped_file = nullptr;
+	m_vertex_storage.release();
+	m_triangle_storage.release();
 	m_vertices = nullptr;
-	delete[] m_triangles;
 	m_triangles = nullptr;
 
 	m_num_vertices = 0;
@@ -230,6 +250,7 @@ void SphericalDelaunay::cleanup()
 	m_triangle_index = 0;
 	m_triangle_capacity = 0;
 	m_triangle_id_count = 0;
+	m_last_insertion_triangle = -1;
 		
 	m_vertices_freeslots.clear();
 	m_triangles_freeslots.clear();
@@ -387,10 +408,12 @@ int SphericalDelaunay::insertVertexAtTriangle(const math::dvec3 & vertex, int tr
 
 int SphericalDelaunay::naiveInsertVertex(const math::dvec3 & vertex)
 {
-	int index = smartFindTriangleThatContains(vertex);
+	int index = smartFindTriangleThatContains(vertex, m_last_insertion_triangle);
 	//if (index == -1)
 		//return -1;
-	return naiveInsertVertexAtTriangle(vertex, index);
+	const int v_index = naiveInsertVertexAtTriangle(vertex, index);
+	m_last_insertion_triangle = m_vertices[v_index].triangle;
+	return v_index;
 }
 
 int SphericalDelaunay::naiveInsertVertexAtTriangle(const math::dvec3 & vertex, int triangle_index)
@@ -476,133 +499,560 @@ int SphericalDelaunay::naiveInsertVertexAtTriangle(const math::dvec3 & vertex, i
 
 int SphericalDelaunay::insertVertex(const math::dvec3 & vertex)
 {
-	int target_triangle_index = smartFindTriangleThatContains(vertex);
+	int target_triangle_index = smartFindTriangleThatContains(vertex, m_last_insertion_triangle);
 	//if (target_triangle_index == -1)
 		//return -1;
 	
-	return insertVertexAtTriangle(vertex, target_triangle_index);
+	const int v_index = insertVertexAtTriangle(vertex, target_triangle_index);
+	m_last_insertion_triangle = m_vertices[v_index].triangle;
+	return v_index;
 }
 
+void SphericalDelaunay::sortInsertionOrder(std::vector<math::dvec3> & samples, unsigned int seed) const
+{
+	const int n = (int)samples.size();
+	if (n < 2)
+		return;
+
+	// random permutation (Fisher-Yates, deterministic for a given seed)
+	std::mt19937 prng(seed);
+	for (int i = n - 1; i > 0; --i)
+		std::swap(samples[i], samples[prng() % (i + 1)]);
+
+	// split into rounds of doubling size (from the end : the last round is the second half), sort each round along the Hilbert curve
+	std::vector<std::pair<uint64_t, int>> keys(n);
+	for (int i = 0; i < n; ++i)
+		keys[i] = std::make_pair(tool::hilbertKey(samples[i], m_sphere_center, m_sphere_radius), i);
+	int end = n;
+	while (end > 0)
+	{
+		const int begin = end > BRIO_FIRST_ROUND_SIZE ? end / 2 : 0;
+		std::sort(keys.begin() + begin, keys.begin() + end);
+		end = begin;
+	}
 
+	std::vector<math::dvec3> sorted(n);
+	for (int i = 0; i < n; ++i)
+		sorted[i] = samples[keys[i].second];
+	samples.swap(sorted);
+}
 
-void SphericalDelaunay::createNaiveTriangulation(const std::vector<math::dvec3> & vertices)
+
+
+int SphericalDelaunay::insertVertexConvexHull(const math::dvec3 & vertex, std::vector<int> * changed_triangles)
 {
-	std::cout << " ... inserting vertices naively" << std::endl;
-	for (math::dvec3 v : vertices)
-	{	
-		int i = smartFindTriangleThatContains(v);		
-		naiveInsertVertexAtTriangle(v, i);		
+	int new_vertex_index = findAvailableVertexSlot();
+	m_vertices[new_vertex_index].coordinates = vertex;
+	m_vertices[new_vertex_index].flags = 0;
+	m_vertices[new_vertex_index].id = m_vertex_id_count;
+	m_vertex_id_count++;
+
+	insertStoredVertexConvexHull(new_vertex_index);
+	if (changed_triangles != nullptr)
+		changed_triangles->insert(changed_triangles->end(), m_cavity.begin(), m_cavity.end());
+	return new_vertex_index;
+}
+
+bool SphericalDelaunay::removeVertex(int vertex_index, std::vector<int> * changed_triangles)
+{
+	if (vertex_index < 0 || vertex_index >= (int)m_vertex_index || VERTEX_DELETED(m_vertices[vertex_index]) || m_num_vertices <= 4)
+		return false;
+
+	// link of the vertex : its incident triangles (v, a, b) in counterclockwise order, the polygon of their a vertices and the triangles beyond its edges (a, b)
+	std::vector<int> hole, polygon, beyond;
+	int t = m_vertices[vertex_index].triangle;
+	do {
+		const SphericalTriangle & T = m_triangles[t];
+		const int k = T.vertex[0] == vertex_index ? 0 : (T.vertex[1] == vertex_index ? 1 : 2);
+		assert(T.vertex[k] == vertex_index);
+		hole.push_back(t);
+		polygon.push_back(T.vertex[(k + 1) % 3]);
+		beyond.push_back(T.neighbor[k]);
+		t = T.neighbor[(k + 1) % 3];
+	} while (t != m_vertices[vertex_index].triangle);
+
+	// ear clipping : an ear (a, b, c) of the polygon is clipped if it is convex and if no other polygon vertex lies within its circumcircle.
+	// Such an ear exists as long as the remaining vertices surround the sphere center. Otherwise the hole has no valid triangulation : the ears are
+	// all chosen before anything is modified, and the vertex is kept if one is missing.
+	std::vector<int> ears, remaining(polygon);
+	while (remaining.size() > 3)
+	{
+		const int n = (int)remaining.size();
+		int ear = -1;
+		for (int i = 0; i < n && ear == -1; ++i)
+		{
+			const math::dvec3 & a = m_vertices[remaining[i]].coordinates;
+			const math::dvec3 & b = m_vertices[remaining[(i + 1) % n]].coordinates;
+			const math::dvec3 & c = m_vertices[remaining[(i + 2) % n]].coordinates;
+			if (predicates::orient3d(a, b, c, m_sphere_center) >= 0.0)
+				continue;// reflex (or flat) corner
+			bool empty = true;
+			for (int j = 3; j < n && empty; ++j)
+				empty = predicates::orient3d(a, b, c, m_vertices[remaining[(i + j) % n]].coordinates) <= 0.0;
+			if (empty)
+				ear = i;
+		}
+		if (ear == -1)
+			return false;
+		ears.push_back(ear);
+		remaining.erase(remaining.begin() + (ear + 1) % n);
+	}
+	if (predicates::orient3d(m_vertices[remaining[0]].coordinates, m_vertices[remaining[1]].coordinates, m_vertices[remaining[2]].coordinates, m_sphere_center) >= 0.0)
+		return false;
+
+	for (int h : hole)
+		m_triangles[h].flags |= 1;
+	if (changed_triangles != nullptr)
+		changed_triangles->insert(changed_triangles->end(), hole.begin(), hole.end());
+
+	// links the triangle beyond the edge (v0, v1) to the new triangle new_t
+	auto link = [this](int beyond_t, int v0, int v1, int new_t)
+	{
+		SphericalTriangle & B = m_triangles[beyond_t];
+		for (int k = 0; k < 3; ++k)
+			if (B.vertex[k] != v0 && B.vertex[k] != v1)
+			{
+				B.neighbor[k] = new_t;
+				return;
+			}
+	};
+
+	// clips the chosen ears, the new triangles reuse the slots of the hole
+	int slot = 0;
+	for (int ear : ears)
+	{
+		const int n = (int)polygon.size();
+		const int i0 = ear, i1 = (ear + 1) % n, i2 = (ear + 2) % n;
+		const int new_t = hole[slot++];
+		SphericalTriangle & T = m_triangles[new_t];
+		T.vertex[0] = polygon[i0];
+		T.vertex[1] = polygon[i1];
+		T.vertex[2] = polygon[i2];
+		T.neighbor[0] = beyond[i1];// across (b, c)
+		T.neighbor[1] = -1;// across (c, a) : the diagonal, linked when the triangle beyond it is created
+		T.neighbor[2] = beyond[i0];// across (a, b)
+		T.flags = 0;
+		link(beyond[i0], polygon[i0], polygon[i1], new_t);
+		link(beyond[i1], polygon[i1], polygon[i2], new_t);
+		m_vertices[polygon[i0]].triangle = new_t;
+		m_vertices[polygon[i1]].triangle = new_t;
+		m_vertices[polygon[i2]].triangle = new_t;
+
+		// the polygon loses b, the diagonal (a, c) is now an edge beyond which lies the new triangle
+		beyond[i0] = new_t;
+		polygon.erase(polygon.begin() + i1);
+		beyond.erase(beyond.begin() + i1);
 	}
+
+	const int new_t = hole[slot++];
+	SphericalTriangle & T = m_triangles[new_t];
+	for (int k = 0; k < 3; ++k)
+	{
+		T.vertex[k] = polygon[k];
+		T.neighbor[k] = beyond[(k + 1) % 3];// across (polygon[k + 1], polygon[k + 2])
+		link(beyond[k], polygon[k], polygon[(k + 1) % 3], new_t);
+		m_vertices[polygon[k]].triangle = new_t;
+	}
+	T.flags = 0;
+
+	// the 2 remaining slots and the vertex slot are free
+	for (; slot < (int)hole.size(); ++slot)
+		m_triangles_freeslots.push_back(hole[slot]);
+	m_vertices[vertex_index].remove();
+	m_vertices_freeslots.push_back(vertex_index);
+	m_num_vertices--;
+	m_num_triangles -= 2;
+	if (m_last_insertion_triangle >= 0 && TRIANGLE_DELETED(m_triangles[m_last_insertion_triangle]))
+		m_last_insertion_triangle = -1;
+	return true;
 }
 
-void SphericalDelaunay::applyLawson()
+void SphericalDelaunay::insertStoredVertexConvexHull(int vertex_index)
 {
-	// Edges construction:
-	std::cout << "  (building edges...";
-	std::unordered_map<uint64_t, SphericalEdge> edges;// constant-time-access map
-	for (int i = 0; i < m_triangle_index; ++i)
+	const math::dvec3 & vertex = m_vertices[vertex_index].coordinates;
+	collectHullCavity(vertex, smartFindTriangleThatContains(vertex, m_last_insertion_triangle), m_cavity, m_horizon);
+
+	// a fan of horizon.size() = cavity.size() + 2 new triangles, reusing the slots of the visible ones
+	while (m_cavity.size() < m_horizon.size())
+		m_cavity.push_back(findAvailableTriangleSlot());
+	replaceHullCavity(vertex_index, m_cavity, m_horizon, true);
+
+	m_num_vertices++;
+	m_num_triangles += 2;
+	m_last_insertion_triangle = m_cavity[0];
+}
+
+bool SphericalDelaunay::collectHullCavity(const math::dvec3 & vertex, int start_triangle, std::vector<int> & cavity, std::vector<SphericalHorizonEdge> & horizon, const int * owners, int owner) const
+{
+	// the containing triangle is visible from the vertex, the other visible triangles are connected to it
+	cavity.clear();
+	cavity.push_back(start_triangle);
+	for (size_t c = 0; c < cavity.size(); ++c)
 	{
-		if (TRIANGLE_DELETED(m_triangles[i]))
-			continue;
+		const SphericalTriangle & t = m_triangles[cavity[c]];
+		for (int k = 0; k < 3; ++k)
+		{
+			const int n = t.neighbor[k];
+			if (n == -1 || std::find(cavity.begin(), cavity.end(), n) != cavity.end())
+				continue;
+			if (owners != nullptr && owners[n] != owner)
+				return false;// n is either visible or beyond the horizon, in both cases it would be modified
+			if (isTriangleVisible(m_triangles[n], vertex))
+				cavity.push_back(n);
+		}
+	}
+
+	// horizon : edges between a visible and a non visible triangle
+	horizon.clear();
+	for (int c : cavity)
+	{
+		const SphericalTriangle & t = m_triangles[c];
+		for (int k = 0; k < 3; ++k)
+		{
+			if (std::find(cavity.begin(), cavity.end(), t.neighbor[k]) != cavity.end())
+				continue;
+			SphericalHorizonEdge edge = { { t.vertex[(k + 1) % 3], t.vertex[(k + 2) % 3] }, t.neighbor[k] };
+			horizon.push_back(edge);
+		}
+	}
+	return true;
+}
+
+void SphericalDelaunay::replaceHullCavity(int vertex_index, const std::vector<int> & slots, const std::vector<SphericalHorizonEdge> & horizon, bool update_vertex_triangles)
+{
+	const int fan_size = (int)horizon.size();
+	for (int i = 0; i < fan_size; ++i)
+	{
+		const SphericalHorizonEdge & edge = horizon[i];
+		SphericalTriangle t;
+		t.vertex[0] = vertex_index;
+		t.vertex[1] = edge.vertex[0];
+		t.vertex[2] = edge.vertex[1];
+		t.neighbor[0] = edge.outside;
+		for (int j = 0; j < fan_size; ++j)
+		{
+			if (horizon[j].vertex[0] == edge.vertex[1])
+				t.neighbor[1] = slots[j];// next triangle of the fan
+			if (horizon[j].vertex[1] == edge.vertex[0])
+				t.neighbor[2] = slots[j];// previous triangle of the fan
+		}
+		t.flags = 0;
+		m_triangles[slots[i]] = t;
+
+		if (edge.outside != -1)
+		{   // update neighborhood (looking for the vertex facing the edge, the outside triangle may be adjacent to several visible triangles)
+			SphericalTriangle & outside = m_triangles[edge.outside];
+			for (int k = 0; k < 3; ++k)
+				if (outside.vertex[k] != edge.vertex[0] && outside.vertex[k] != edge.vertex[1])
+				{
+					outside.neighbor[k] = slots[i];
+					break;
+				}
+		}
+		if (update_vertex_triangles)
+			m_vertices[edge.vertex[0]].triangle = slots[i];
+	}
+	if (update_vertex_triangles)
+		m_vertices[vertex_index].triangle = slots[0];
+}
 
-		int v0 = m_triangles[i].vertex[0];
-		int v1 = m_triangles[i].vertex[1];
-		int v2 = m_triangles[i].vertex[2];
+void SphericalDelaunay::createConvexHull(const std::vector<math::dvec3> & vertices)
+{
+	m_cavity.reserve(64);
+	m_horizon.reserve(64);
+	for (const math::dvec3 & v : vertices)
+		insertVertexConvexHull(v);
+}
 
-		uint64_t akey01 = hashEdge(v0, v1);
-		uint64_t akey02 = hashEdge(v0, v2);
-		uint64_t akey12 = hashEdge(v1, v2);
+void SphericalDelaunay::insertVerticesParallel(const std::vector<math::dvec3> & vertices, unsigned int num_threads)
+{
+	if (num_threads == 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	const int n = (int)vertices.size();
+	if (n == 0)
+		return;
+
+	// all vertices are stored upfront, in order : their indices are the same as with sequential insertion
+	if (m_mapped_file != nullptr)
+		detachFromMappedFile();
+	reserveVertices(m_vertex_index + n);
+	const int first_vertex = m_vertex_index;
+	for (int i = 0; i < n; ++i)
+	{
+		SphericalVertex & v = m_vertices[first_vertex + i];
+		v.coordinates = vertices[i];
+		v.flags = 0;
+		v.id = m_vertex_id_count + i;
+		v.triangle = -1;
+	}
+	m_vertex_index += n;
+	m_vertex_id_count += n;
+	m_cavity.reserve(64);
+	m_horizon.reserve(64);
+
+	// rounds of doubling size, as made by sortInsertionOrder : each round is sorted along the Hilbert curve and is about as large as the triangulation it is inserted in
+	std::vector<int> rounds;
+	for (int end = n; end > 0; )
+	{
+		rounds.push_back(end);
+		end = end > BRIO_FIRST_ROUND_SIZE ? end / 2 : 0;
+	}
+	rounds.push_back(0);
+	std::reverse(rounds.begin(), rounds.end());
 
-		auto it = edges.find(akey01);
-		if (it == edges.end())
+	std::vector<int> owners;
+	for (size_t r = 0; r + 1 < rounds.size(); ++r)
+	{
+		const int begin = rounds[r], end = rounds[r + 1];
+		const int count = end - begin;
+		if (num_threads == 1 || count < (int)num_threads * PARALLEL_INSERTION_MIN_PART_SIZE)
 		{
-			SphericalEdge edge01 = { v0, v1, i, -1 };
-			edges[akey01] = edge01;
+			for (int i = begin; i < end; ++i)
+				insertStoredVertexConvexHull(first_vertex + i);
+			continue;
 		}
-		else
-			it->second.triangle[1] = i;
 
-		it = edges.find(akey02);
-		if (it == edges.end())
+		// the round is split into num_threads contiguous parts of the Hilbert curve, ie. into compact regions of the sphere.
+		// Each triangle belongs to the part its centroid falls in, and each part is inserted by one thread, modifying its own triangles only.
+		std::vector<uint64_t> part_keys(num_threads, 0);
+		for (unsigned int t = 1; t < num_threads; ++t)
+			part_keys[t] = tool::hilbertKey(vertices[begin + (int)((int64_t)count * t / num_threads)], m_sphere_center, m_sphere_radius);
+		auto partOf = [&part_keys](uint64_t key) { return (int)(std::upper_bound(part_keys.begin(), part_keys.end(), key) - part_keys.begin()) - 1; };
+
+		// 2 new triangle slots per vertex, initially deleted (they are left unused if the vertex is deferred)
+		const int first_slot = m_triangle_index;
+		reserveTriangles(first_slot + 2 * count);
+		m_triangle_index += 2 * count;
+		owners.resize(m_triangle_index);
+		std::vector<std::pair<uint64_t, int>> triangle_keys;// triangles sorted along the curve, to find a triangle of the region close to a vertex
+		triangle_keys.reserve(m_num_triangles);
+		for (int i = 0; i < first_slot; ++i)
 		{
-			SphericalEdge edge02 = { v0, v2, i, -1 };
-			edges[akey02] = edge02;
+			const SphericalTriangle & t = m_triangles[i];
+			if (TRIANGLE_DELETED(t))
+			{
+				owners[i] = -1;
+				continue;
+			}
+			const math::dvec3 centroid = m_vertices[t.vertex[0]].coordinates + m_vertices[t.vertex[1]].coordinates + m_vertices[t.vertex[2]].coordinates;
+			const uint64_t key = tool::hilbertKey(m_sphere_radius * math::normalize(centroid - 3.0 * m_sphere_center) + m_sphere_center, m_sphere_center, m_sphere_radius);
+			owners[i] = partOf(key);
+			triangle_keys.push_back(std::make_pair(key, i));
 		}
-		else
-			it->second.triangle[1] = i;
+		std::sort(triangle_keys.begin(), triangle_keys.end());
+		std::vector<int> part_begin(num_threads + 1, end);
+		for (unsigned int t = 0; t < num_threads; ++t)
+			part_begin[t] = begin + (int)((int64_t)count * t / num_threads);
+		for (unsigned int t = 0; t < num_threads; ++t)
+			for (int i = part_begin[t]; i < part_begin[t + 1]; ++i)
+			{
+				const int slot = first_slot + 2 * (i - begin);
+				m_triangles[slot].flags = 1;
+				m_triangles[slot + 1].flags = 1;
+				owners[slot] = owners[slot + 1] = (int)t;
+			}
 
-		it = edges.find(akey12);
-		if (it == edges.end())
+		std::vector<std::vector<int>> deferred(num_threads);
+		std::vector<int> inserted(num_threads, 0);
+		auto worker = [&](unsigned int part)
+		{
+			std::vector<int> cavity;
+			std::vector<SphericalHorizonEdge> horizon;
+			cavity.reserve(64);
+			horizon.reserve(64);
+			int last = -1;
+			for (int i = part_begin[part]; i < part_begin[part + 1]; ++i)
+			{
+				const int vertex_index = first_vertex + i;
+				const math::dvec3 & vertex = m_vertices[vertex_index].coordinates;
+				int start = last == -1 ? -1 : smartFindTriangleThatContains(vertex, last, owners.data(), (int)part);
+				if (start == -1)
+				{   // a region may be made of several patches of the sphere (the curve runs inside the ball) : restart from the triangle of the region closest to the vertex along the curve
+					auto it = std::lower_bound(triangle_keys.begin(), triangle_keys.end(), std::make_pair(tool::hilbertKey(vertex, m_sphere_center, m_sphere_radius), 0));
+					if (it == triangle_keys.end() || owners[it->second] != (int)part)
+						it = it == triangle_keys.begin() ? it : it - 1;
+					if (it != triangle_keys.end() && owners[it->second] == (int)part)
+						start = smartFindTriangleThatContains(vertex, it->second, owners.data(), (int)part);
+				}
+				if (start == -1 || !collectHullCavity(vertex, start, cavity, horizon, owners.data(), (int)part) || horizon.size() != cavity.size() + 2)
+				{
+					deferred[part].push_back(vertex_index);// the cavity crosses the region of another thread
+					continue;
+				}
+				const int slot = first_slot + 2 * (i - begin);
+				cavity.push_back(slot);
+				cavity.push_back(slot + 1);
+				replaceHullCavity(vertex_index, cavity, horizon, false);
+				last = cavity[0];
+				inserted[part]++;
+			}
+		};
+		std::vector<std::thread> threads;
+		for (unsigned int t = 1; t < num_threads; ++t)
+			threads.emplace_back(worker, t);
+		worker(0);
+		for (std::thread & thread : threads)
+			thread.join();
+
+		for (unsigned int t = 0; t < num_threads; ++t)
 		{
-			SphericalEdge edge12 = { v1, v2, i, -1 };
-			edges[akey12] = edge12;
+			m_num_vertices += inserted[t];
+			m_num_triangles += 2 * inserted[t];
 		}
-		else
-			it->second.triangle[1] = i;
+		updateVertexTriangles();
+		for (int slot = m_triangle_index - 1; slot >= first_slot; --slot)
+			if (TRIANGLE_DELETED(m_triangles[slot]))
+				m_triangles_freeslots.push_back(slot);
+		m_last_insertion_triangle = m_vertices[first_vertex + end - 1].triangle;
+
+		// then the deferred vertices, sequentially, in order (they use the unused slots)
+		for (unsigned int t = 0; t < num_threads; ++t)
+			for (int vertex_index : deferred[t])
+				insertStoredVertexConvexHull(vertex_index);
 	}
-	//std::cout << " " << edges.size() << ")" << std::endl;
+	updateVertexTriangles();
+}
 
-	// Edges scan - we store in a list those that need to be flipped (to garantee the Delaunay condition):
-	std::list<uint64_t> flipList;
-	for (auto it = edges.begin(); it != edges.end(); ++it)
+void SphericalDelaunay::updateVertexTriangles()
+{
+	for (int i = 0; i < (int)m_triangle_index; ++i)
 	{
-		if (it->second.triangle[0] == -1 || it->second.triangle[1] == -1)
+		const SphericalTriangle & t = m_triangles[i];
+		if (TRIANGLE_DELETED(t))
 			continue;
-		if (!checkEdgeDelaunay(it->second))
-			flipList.push_back(it->first);
+		for (int k = 0; k < 3; ++k)
+			m_vertices[t.vertex[k]].triangle = i;
 	}
+}
 
-	//std::cout << "  (flipping edges...)" << std::endl;
-	// Edges processing (LAWSON's algorithm) :	
-	while (!flipList.empty())
+void SphericalDelaunay::sortTriangles()
+{
+	if (m_mapped_file != nullptr)
+		detachFromMappedFile();
+
+	// rotate each triangle so that its smallest vertex index comes first (winding order is preserved), the sort key is then its vertex indices
+	std::vector<int> order;
+	order.reserve(m_num_triangles);
+	for (int i = 0; i < (int)m_triangle_index; ++i)
+	{
+		SphericalTriangle & t = m_triangles[i];
+		if (TRIANGLE_DELETED(t))
+			continue;
+		const int r = (t.vertex[0] < t.vertex[1]) ? (t.vertex[0] < t.vertex[2] ? 0 : 2) : (t.vertex[1] < t.vertex[2] ? 1 : 2);
+		if (r != 0)
+		{
+			const SphericalTriangle rotated = t;
+			for (int k = 0; k < 3; ++k)
+			{
+				t.vertex[k] = rotated.vertex[(k + r) % 3];
+				t.neighbor[k] = rotated.neighbor[(k + r) % 3];
+			}
+		}
+		order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [this](int a, int b) {
+		const SphericalTriangle & A = m_triangles[a];
+		const SphericalTriangle & B = m_triangles[b];
+		return std::lexicographical_compare(A.vertex, A.vertex + 3, B.vertex, B.vertex + 3);
+	});
+
+	std::vector<int> new_index(m_triangle_index, -1);
+	for (int i = 0; i < (int)order.size(); ++i)
+		new_index[order[i]] = i;
+	order.clear();
+	order.shrink_to_fit();
+	for (int i = 0; i < (int)m_triangle_index; ++i)
+	{
+		SphericalTriangle & t = m_triangles[i];
+		if (TRIANGLE_DELETED(t))
+			continue;
+		for (int k = 0; k < 3; ++k)
+			if (t.neighbor[k] != -1)
+				t.neighbor[k] = new_index[t.neighbor[k]];
+	}
+	if (m_last_insertion_triangle >= 0)
+		m_last_insertion_triangle = new_index[m_last_insertion_triangle];
+
+	// permute in place, cycle by cycle (deleted triangles end up past the live ones)
+	for (int i = 0; i < (int)m_triangle_index; ++i)
+	{
+		while (new_index[i] != -1 && new_index[i] != i)
+		{
+			const int j = new_index[i];
+			std::swap(m_triangles[i], m_triangles[j]);
+			std::swap(new_index[i], new_index[j]);
+		}
+	}
+	m_triangle_index = m_num_triangles;
+	m_triangles_freeslots.clear();
+	updateVertexTriangles();
+}
+
+void SphericalDelaunay::reserveVertices(unsigned int capacity)
+{
+	if (capacity <= m_vertex_capacity)
+		return;
+	m_vertex_storage.grow(capacity);// in place : m_vertices does not move (unless the reserved address range is exceeded)
+	m_vertices = m_vertex_storage.data();
+	m_vertex_capacity = capacity;
+}
+
+void SphericalDelaunay::reserveTriangles(unsigned int capacity)
+{
+	if (capacity <= m_triangle_capacity)
+		return;
+	m_triangle_storage.grow(capacity);
+	m_triangles = m_triangle_storage.data();
+	m_triangle_capacity = capacity;
+}
+
+void SphericalDelaunay::createNaiveTriangulation(const std::vector<math::dvec3> & vertices)
+{
+	std::cout << " ... inserting vertices naively" << std::endl;
+	for (math::dvec3 v : vertices)
+		naiveInsertVertex(v);
+}
+
+void SphericalDelaunay::applyLawson()
+{
+	// Edges are referenced as (triangle, index of the facing vertex), directly on the triangles adjacency : no edge map.
+	// Entries may become stale after a flip, this is harmless since every flip pushes the 4 edges around the new diagonal at their new location.
+	std::vector<std::pair<int, int>> flipStack;
+	flipStack.reserve(m_triangle_index);
+
+	// Edges scan (each edge once, from its lower triangle index) - we store in a stack those that need to be flipped (to garantee the Delaunay condition):
+	for (int i = 0; i < m_triangle_index; ++i)
+	{
+		if (TRIANGLE_DELETED(m_triangles[i]))
+			continue;
+		for (int k = 0; k < 3; ++k)
+			if (m_triangles[i].neighbor[k] > i)
+				flipStack.push_back(std::make_pair(i, k));
+	}
+
+	// Edges processing (LAWSON's algorithm) :
+	while (!flipStack.empty())
 	{
-		uint64_t edgeKey = flipList.front();
-		flipList.pop_front();
+		const std::pair<int, int> entry = flipStack.back();
+		flipStack.pop_back();
 
-		auto e = edges.find(edgeKey);
-		if (e == edges.end() || e->second.triangle[0] == -1 || e->second.triangle[1] == -1)
+		const SphericalTriangle & t = m_triangles[entry.first];
+		const int k = entry.second;
+		if (t.neighbor[k] == -1)
+			continue;
+		SphericalEdge edge = { { t.vertex[(k + 1) % 3], t.vertex[(k + 2) % 3] }, { entry.first, t.neighbor[k] } };
+		if (checkEdgeDelaunay(edge))
 			continue;
-		SphericalEdge edge = e->second;
 
-		// Indices of vertices like so:
-		//		v0, v1, v2 within the first triangle, v within the second one,
-		//      v0 and v facing the edge
-		//      v0, v1 and v2 in counterclockwise order
+		// after the flip : edge.triangle[0] = (v0, v1, v) and edge.triangle[1] = (v0, v, v2) (see flipEdge)
 		int v, v0, v1, v2;
 		flipEdge(edge, v, v0, v1, v2);
 
-		// Edges update:
-		edges.erase(edgeKey);
-
-		SphericalEdge new_edge;
-		new_edge.vertex[0] = v0;
-		new_edge.vertex[1] = v;
-		new_edge.triangle[0] = edge.triangle[0];
-		new_edge.triangle[1] = edge.triangle[1];
-		edges[hashEdge(v0, v)] = new_edge;
-
-		SphericalEdge & e0_20 = edges.find(hashEdge(v2, v0))->second;
-		if (e0_20.triangle[0] == edge.triangle[0])
-			e0_20.triangle[0] = edge.triangle[1];
-		else if (e0_20.triangle[1] == edge.triangle[0])
-			e0_20.triangle[1] = edge.triangle[1];
-
-		SphericalEdge & e1_20 = edges.find(hashEdge(v1, v))->second;
-		if (e1_20.triangle[0] == edge.triangle[1])
-			e1_20.triangle[0] = edge.triangle[0];
-		else if (e1_20.triangle[1] == edge.triangle[1])
-			e1_20.triangle[1] = edge.triangle[0];
-
-		// Eval of the 4 adjacent edges (around the flipped edge that is) and possibly add them to the Lawson list:
-		uint64_t adjacents[4] = { hashEdge(v0, v1), hashEdge(v1, v), hashEdge(v, v2), hashEdge(v2, v0) };
-		for (int k = 0; k < 4; ++k)
-		{
-			const SphericalEdge & adje = edges[adjacents[k]];
-			if (adje.triangle[0] == -1 || adje.triangle[1] == -1)
-				continue;
-			if (!checkEdgeDelaunay(adje))
-				flipList.push_back(adjacents[k]);
-		}
+		// the 4 adjacent edges (around the flipped edge that is) may not be Delaunay any more:
+		flipStack.push_back(std::make_pair(edge.triangle[0], 0));// (v1, v)
+		flipStack.push_back(std::make_pair(edge.triangle[0], 2));// (v0, v1)
+		flipStack.push_back(std::make_pair(edge.triangle[1], 0));// (v, v2)
+		flipStack.push_back(std::make_pair(edge.triangle[1], 1));// (v2, v0)
 	}
 }
 
@@ -710,17 +1160,9 @@ bool SphericalDelaunay::checkEdgeDelaunay(const SphericalEdge & edge) const
 	}
 	int v = t1.vertex[i];
 
-	// Compute the circumscribed circle to (v0, v1, v2)
-	math::dvec3 p0 = m_vertices[v0].coordinates;
-	math::dvec3 p1 = m_vertices[v1].coordinates;
-	math::dvec3 p2 = m_vertices[v2].coordinates;
-	math::dvec3 n = math::cross( p1 - p0 , p2 - p0);
-	math::dvec3 c_center = m_sphere_radius * math::normalize(n);//center on the sphere of the circumscribed circle
-	math::dvec3 OC = math::normalize(c_center - m_sphere_center);
-	double c_normalized_radius = std::acos(math::dot(OC, math::normalize(p0 - m_sphere_center)));//pseudo radius of the circumscribed circle
-
-																							 // Test if v falls within the circle:
-	return  c_normalized_radius  <  std::acos(math::dot(OC, math::normalize(m_vertices[v].coordinates - m_sphere_center)));
+	// On the sphere, v falls within the circumscribed circle of (v0, v1, v2) iff it lies above their plane.
+	// Co-circular points are considered Delaunay so that they are never flipped back and forth.
+	return predicates::orient3d(m_vertices[v0].coordinates, m_vertices[v1].coordinates, m_vertices[v2].coordinates, m_vertices[v].coordinates) <= 0.0;
 }
 
 
@@ -755,14 +1197,57 @@ double SphericalDelaunay::getAverageTriangleEdgeLength() const
 	return edge/count;
 }
 
+void SphericalDelaunay::getVertexTriangles(std::vector<int> & offsets, std::vector<int> & triangles) const
+{
+	// row sizes (vertex degrees), then offsets by prefix sum
+	offsets.assign(m_vertex_index + 1, 0);
+	for (int i = 0; i < (int)m_triangle_index; ++i)
+	{
+		const SphericalTriangle & t = m_triangles[i];
+		if (TRIANGLE_DELETED(t))
+			continue;
+		for (int k = 0; k < 3; ++k)
+			offsets[t.vertex[k] + 1]++;
+	}
+	for (int v = 0; v < (int)m_vertex_index; ++v)
+		offsets[v + 1] += offsets[v];
+
+	// each row : turn counterclockwise around the vertex from its triangle (v, a, b), to the neighbor across the edge (b, v)
+	triangles.resize(offsets[m_vertex_index]);
+	for (int v = 0; v < (int)m_vertex_index; ++v)
+	{
+		if (offsets[v] == offsets[v + 1])
+			continue;
+		int t = m_vertices[v].triangle;
+		for (int j = offsets[v]; j < offsets[v + 1]; ++j)
+		{
+			triangles[j] = t;
+			const SphericalTriangle & T = m_triangles[t];
+			const int k = T.vertex[0] == v ? 0 : (T.vertex[1] == v ? 1 : 2);
+			assert(T.vertex[k] == v);
+			t = T.neighbor[(k + 1) % 3];
+		}
+		assert(t == m_vertices[v].triangle);
+	}
+}
+
 
-int SphericalDelaunay::smartFindTriangleThatContains(math::dvec3 p) const
+int SphericalDelaunay::smartFindTriangleThatContains(math::dvec3 p, int start_triangle, const int * owners, int owner) const
 {
 	//std::set<int> visited;
-	int t_index;
-	do {
-		t_index = rand() % m_triangle_index;// pick-up a random starting triangle
-	} while (TRIANGLE_DELETED(m_triangles[t_index]));
+	int t_index = start_triangle;
+	unsigned int step = 0;
+	// local PRNG for the random restarts : the global rand() state (used by the base planet construction) must not depend on the triangulation being built or loaded
+	uint32_t prng = 2463534242u;
+	auto rand = [&prng]() { prng ^= prng << 13; prng ^= prng >> 17; prng ^= prng << 5; return (int)(prng >> 1); };
+	if (t_index < 0 || t_index >= (int)m_triangle_index || TRIANGLE_DELETED(m_triangles[t_index]))
+	{
+		if (owners != nullptr)
+			return -1;
+		do {
+			t_index = rand() % m_triangle_index;// pick-up a random starting triangle
+		} while (TRIANGLE_DELETED(m_triangles[t_index]));
+	}
 	
 	while (true)
 	{
@@ -776,6 +1261,8 @@ int SphericalDelaunay::smartFindTriangleThatContains(math::dvec3 p) const
 
 		if (math::dot(v0 - m_sphere_center, p - m_sphere_center) < 0.0)// quick test : if p is in the opposite hemisphere with respect to the current triangle...
 		{
+			if (owners != nullptr)
+				return -1;
 			do {
 				t_index = rand() % m_triangle_index;// ... then pick-up a new random triangle
 			} while (TRIANGLE_DELETED(m_triangles[t_index]));
@@ -788,32 +1275,32 @@ int SphericalDelaunay::smartFindTriangleThatContains(math::dvec3 p) const
 		if (T.intersect(R, DBL_MAX, ht, u, w))
 			return t_index;*/
 
-		// compute the three normals:
-		math::dvec3 O0 = math::normalize(v0 - m_sphere_center);
-		math::dvec3 O1 = math::normalize(v1 - m_sphere_center);
-		math::dvec3 O2 = math::normalize(v2 - m_sphere_center);
-
-		math::dvec3 n0 = math::cross(O1, O2); 
-		math::dvec3 n1 = math::cross(O2, O0);
-		math::dvec3 n2 = math::cross(O0, O1);
-		
-		double d0 = math::dot(math::normalize(p - v1), n0);
-		double d1 = math::dot(math::normalize(p - v2), n1);
-		double d2 = math::dot(math::normalize(p - v0), n2);
-		bool test0 = (d0 >= EPSILON_TEST);
-		bool test1 = (d1 >= EPSILON_TEST);
-		bool test2 = (d2 >= EPSILON_TEST);
-		if (test0 && test1 && test2)
+		// p must lie on the inner side of the three planes through the sphere center and an edge (exact predicates : the walk can not cycle on rounding errors)
+		const bool test[3] = {
+			predicates::orient3d(m_sphere_center, v1, v2, p) >= 0.0,
+			predicates::orient3d(m_sphere_center, v2, v0, p) >= 0.0,
+			predicates::orient3d(m_sphere_center, v0, v1, p) >= 0.0
+		};
+		if (test[0] && test[1] && test[2])
 			return t_index;//we found the containing triangle, return.
 
-		// Else move to a neighboring triangle in the right direction
-		if (!test0 && t.neighbor[0] != -1)
-			t_index = t.neighbor[0];
-		else if (!test1 && t.neighbor[1] != -1)
-			t_index = t.neighbor[1];
-		else if (!test2 && t.neighbor[2] != -1)
-			t_index = t.neighbor[2];
-		else do {
+		// Else move to a neighboring triangle in the right direction, trying the edges from a rotating first one (stochastic walk, which always terminates)
+		step++;
+		int k = 0;
+		for (; k < 3; ++k)
+		{
+			const int e = (step + k) % 3;
+			if (!test[e] && t.neighbor[e] != -1)
+			{
+				if (owners != nullptr && owners[t.neighbor[e]] != owner)
+					return -1;// the walk leaves the region
+				t_index = t.neighbor[e];
+				break;
+			}
+		}
+		if (k == 3 && owners != nullptr)
+			return -1;
+		if (k == 3) do {
 			t_index = rand() % m_triangle_index;
 		} while (TRIANGLE_DELETED(m_triangles[t_index]));
 	}
@@ -950,17 +1437,12 @@ int SphericalDelaunay::findAvailableTriangleSlot()
 	int slot;
 	if (m_triangles_freeslots.empty())
 	{
+		if (m_mapped_file != nullptr)
+			detachFromMappedFile();
 		slot = m_triangle_index;		
 		m_triangle_index++;
 		if (m_triangle_index >= m_triangle_capacity)
-		{
-			SphericalTriangle * tmp = new SphericalTriangle[2 * m_triangle_capacity];
-			for (int i = 0; i < m_triangle_capacity; ++i)
-				tmp[i] = m_triangles[i];
-			delete[] m_triangles;
-			m_triangles = tmp;
-			m_triangle_capacity *= 2;
-		}		
+			reserveTriangles(2 * m_triangle_capacity);
 		return slot;
 	}
 	
@@ -974,17 +1456,12 @@ int SphericalDelaunay::findAvailableVertexSlot()
 	int slot;
 	if (m_vertices_freeslots.empty())
 	{
+		if (m_mapped_file != nullptr)
+			detachFromMappedFile();
 		slot = m_vertex_index;
 		m_vertex_index++;
 		if (m_vertex_index >= m_vertex_capacity)
-		{
-			SphericalVertex * tmp = new SphericalVertex[2 * m_vertex_capacity];
-			for (int i = 0; i < m_vertex_capacity; ++i)
-				tmp[i] = m_vertices[i];
-			delete[] m_vertices;
-			m_vertices = tmp;
-			m_vertex_capacity *= 2;
-		}		
+			reserveVertices(2 * m_vertex_capacity);
 		return slot;
 	}
 
@@ -993,47 +1470,97 @@ int SphericalDelaunay::findAvailableVertexSlot()
 	return slot;
 }
 
-bool SphericalDelaunay::loadFromDisk(std::string&  filename)
+void SphericalDelaunay::detachFromMappedFile()
+{
+	m_vertex_storage.grow(std::max(2 * m_vertex_index, 8u));
+	std::copy(m_vertices, m_vertices + m_vertex_index, m_vertex_storage.data());
+	m_triangle_storage.grow(std::max(2 * m_triangle_index, 32u));
+	std::copy(m_triangles, m_triangles + m_triangle_index, m_triangle_storage.data());
+
+	delete m_mapped_file;
+	m_mapped_file = nullptr;
+	m_vertices = m_vertex_storage.data();
+	m_vertex_capacity = (unsigned int)m_vertex_storage.capacity();
+	m_triangles = m_triangle_storage.data();
+	m_triangle_capacity = (unsigned int)m_triangle_storage.capacity();
+}
+
+static inline uint64_t alignSection(uint64_t offset)
+{
+	return (offset + SDT_FILE_SECTION_ALIGNMENT - 1) / SDT_FILE_SECTION_ALIGNMENT * SDT_FILE_SECTION_ALIGNMENT;
+}
+
+bool SphericalDelaunay::loadFromDisk(const std::string & filename)
 {
 	cleanup();
 
 	std::cout << "Loading Spherical Delaunay Triangulation from disk (" << filename << ")... " << std::endl;
-	std::ifstream file(filename.c_str(), std::ifstream::in | std::ifstream::binary);
-	if (!file.good())
+	tool::MappedFile * file = new tool::MappedFile;
+	if (!file->open(filename))
 	{
 		std::cout << "ERROR - failed opening " << filename << std::endl;
+		delete file;
 		return false;
-	}		
-
-	file.read((char*)&m_sphere_radius, sizeof(double));
-	file.read((char*)&m_sphere_center, sizeof(math::dvec3));
-
-	file.read((char*)&m_num_vertices, sizeof(int));
-	file.read((char*)&m_num_triangles, sizeof(int));
-
-	file.read((char*)&m_vertex_index, sizeof(int));
-	file.read((char*)&m_triangle_index, sizeof(int));
-
-	m_vertices = new SphericalVertex[2 * m_vertex_index];
-	m_triangles = new SphericalTriangle[2 * m_triangle_index];
-	m_triangle_capacity = 2 * m_triangle_index;
-	m_vertex_capacity = 2 * m_vertex_index;
-
-	for (int i = 0; i < m_vertex_index; ++i)
-		file.read((char*)(m_vertices + i), sizeof(SphericalVertex));//m_vertices[i].load(file);
+	}
 
-	for (int i = 0; i < m_triangle_index; ++i)
-		file.read((char*)(m_triangles + i), sizeof(SphericalTriangle));
+	// validate the header, the layout of the sections and the checksum before using anything in place:
+	const char * error = nullptr;
+	SphericalDelaunayFileHeader header;
+	if (file->size() < sizeof(header))
+		error = "truncated header";
+	else
+	{
+		std::memcpy(&header, file->data(), sizeof(header));
+		const uint64_t vertex_bytes = (uint64_t)header.vertex_range * sizeof(SphericalVertex);
+		const uint64_t triangle_bytes = (uint64_t)header.triangle_range * sizeof(SphericalTriangle);
+		if (std::memcmp(header.magic, "SDT", 4) != 0)
+			error = "not a .sdt file";
+		else if (header.version != SDT_FILE_VERSION)
+			error = "unsupported version";
+		else if (header.endianness != 0x01020304u || header.header_size != sizeof(SphericalDelaunayFileHeader) || header.vertex_size != sizeof(SphericalVertex) || header.triangle_size != sizeof(SphericalTriangle))
+			error = "written by an incompatible host";
+		else if (header.file_size != file->size() || header.vertex_offset % SDT_FILE_SECTION_ALIGNMENT != 0 || header.triangle_offset % SDT_FILE_SECTION_ALIGNMENT != 0
+			|| header.vertex_offset < sizeof(header) || header.vertex_offset + vertex_bytes > header.triangle_offset || header.triangle_offset + triangle_bytes > header.file_size)
+			error = "corrupted section layout";
+		else
+		{
+			const uint64_t checksums[2] = { tool::checksum64(file->data() + header.vertex_offset, (size_t)vertex_bytes), tool::checksum64(file->data() + header.triangle_offset, (size_t)triangle_bytes) };
+			if (header.checksum != tool::checksum64(checksums, sizeof(checksums)))
+				error = "checksum mismatch";
+		}
+	}
+	if (error != nullptr)
+	{
+		std::cout << "ERROR - " << filename << " : " << error << std::endl;
+		delete file;
+		return false;
+	}
 
-	file.close();
+	m_mapped_file = file;
+	m_sphere_radius = header.sphere_radius;
+	m_sphere_center = math::dvec3(header.sphere_center[0], header.sphere_center[1], header.sphere_center[2]);
+	m_num_vertices = header.num_vertices;
+	m_num_triangles = header.num_triangles;
+	m_vertex_index = header.vertex_range;
+	m_triangle_index = header.triangle_range;
+	m_vertex_capacity = m_vertex_index;
+	m_triangle_capacity = m_triangle_index;
+	m_vertices = (SphericalVertex*)(file->data() + header.vertex_offset);
+	m_triangles = (SphericalTriangle*)(file->data() + header.triangle_offset);
 
 	m_vertex_id_count = m_vertex_index;
 	m_triangle_id_count = m_triangle_index;
+	for (int i = 0; i < (int)m_vertex_index; ++i)
+		if (VERTEX_DELETED(m_vertices[i]))
+			m_vertices_freeslots.push_back(i);
+	for (int i = 0; i < (int)m_triangle_index; ++i)
+		if (TRIANGLE_DELETED(m_triangles[i]))
+			m_triangles_freeslots.push_back(i);
 
 	return true;
 }
 
-bool SphericalDelaunay::persistToDisk(std::string & filename)
+bool SphericalDelaunay::persistToDisk(const std::string & filename) const
 {
 	std::cout << "Persisting Spherical Delaunay Triangulation to disk (" << filename << ")... " << std::endl;
 	std::ofstream file(filename.c_str(), std::ofstream::out | std::ofstream::binary);
@@ -1042,26 +1569,44 @@ bool SphericalDelaunay::persistToDisk(std::string & filename)
 		std::cout << "ERROR - failed opening " << filename << std::endl;
 		return false;
 	}
-	
-	file.write((char*)&m_sphere_radius, sizeof(double));//write sphere radius
-	file.write((char*)&m_sphere_center, sizeof(math::dvec3));//write sphere center
-
-	file.write((char*)&m_num_vertices, sizeof(int));
-	file.write((char*)&m_num_triangles, sizeof(int));
-
-	file.write((char*)&m_vertex_index, sizeof(int));// write vertex range
-	file.write((char*)&m_triangle_index, sizeof(int));// write triangle range
-
-	for (int i = 0; i < m_vertex_index; ++i)// write all vertices
-		file.write((char*)(m_vertices + i), sizeof(SphericalVertex));//m_vertices[i].persist(file);
-	
-	for (int i = 0; i < m_triangle_index; ++i)// write all triangles (even those deleted)
-		file.write((char*)(m_triangles + i), sizeof(SphericalTriangle));
 
+	// [header | padding | all vertices | padding | all triangles (even those deleted)], see SphericalDelaunayFileHeader
+	const uint64_t vertex_bytes = (uint64_t)m_vertex_index * sizeof(SphericalVertex);
+	const uint64_t triangle_bytes = (uint64_t)m_triangle_index * sizeof(SphericalTriangle);
+	SphericalDelaunayFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, "SDT", 4);
+	header.version = SDT_FILE_VERSION;
+	header.endianness = 0x01020304u;
+	header.header_size = sizeof(SphericalDelaunayFileHeader);
+	header.vertex_size = sizeof(SphericalVertex);
+	header.triangle_size = sizeof(SphericalTriangle);
+	header.num_vertices = m_num_vertices;
+	header.num_triangles = m_num_triangles;
+	header.vertex_range = m_vertex_index;
+	header.triangle_range = m_triangle_index;
+	header.sphere_radius = m_sphere_radius;
+	for (int k = 0; k < 3; ++k)
+		header.sphere_center[k] = m_sphere_center[k];
+	header.vertex_offset = alignSection(sizeof(header));
+	header.triangle_offset = alignSection(header.vertex_offset + vertex_bytes);
+	header.file_size = header.triangle_offset + triangle_bytes;
+
+	// each section is checksummed in place (no copy of the arrays)
+	const uint64_t checksums[2] = { tool::checksum64(m_vertices, (size_t)vertex_bytes), tool::checksum64(m_triangles, (size_t)triangle_bytes) };
+	header.checksum = tool::checksum64(checksums, sizeof(checksums));
+
+	const char zeros[SDT_FILE_SECTION_ALIGNMENT] = {};
+	file.write((const char*)&header, sizeof(header));
+	file.write(zeros, header.vertex_offset - sizeof(header));
+	file.write((const char*)m_vertices, vertex_bytes);
+	file.write(zeros, header.triangle_offset - header.vertex_offset - vertex_bytes);
+	file.write((const char*)m_triangles, triangle_bytes);
 	file.close();
+	if (file.fail())
+	{
+		std::cout << "ERROR - failed writing " << filename << std::endl;
+		return false;
+	}
 	return true;
 }
-
-
-
-
@@ -2,6 +2,8 @@
 
 #include "tool.h"
 #include "PoissonSphereSampling.h"
+#include "LatticeSphereSampling.h"
+#include "RobustPredicates.h"
 
 #include <cassert>
 #include <vector>
@@ -11,14 +13,28 @@
 #include <iostream>
 
 
-#define EPSILON_TEST  0.0
+// ---- options ----
+//#define SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION		// if defined then the poisson constructor uses the former construction (naive triangulation + Lawson flips + incremental insertion with flips) instead of the convex hull one
+
 #define MAX_PER_VERTEX_TRIANGLE_INCIDENCE		16	// large enough
+#define SDT_FILE_VERSION						3	// version of the .sdt file format (see SphericalDelaunayFileHeader)
+#define SDT_FILE_SECTION_ALIGNMENT				64	// byte alignment of the sections of the .sdt files
+#define BRIO_FIRST_ROUND_SIZE					64	// size of the first (random) round of the biased randomized insertion order, the following rounds double in size
+#define PARALLEL_INSERTION_MIN_PART_SIZE		1024	// minimum number of vertices per thread for a round to be inserted in parallel (smaller rounds are inserted sequentially)
 
 
 //Fwdcl:
 struct SphericalVertex;
 
 
+/// How the sphere is sampled before being triangulated.
+enum class SphereSamplingMethod
+{
+	POISSON,	/// Poisson disk sampling (blue noise, default)
+	LATTICE		/// jittered Fibonacci lattice : no dart throwing, for fast preview planets
+};
+
+
 struct SphericalTriangle
 {
 	int vertex[3];/// indices of the 3 vertices
@@ -51,6 +67,13 @@ struct SphericalEdge
 	int triangle[2];/// indices of the 2 neighboring triangles
 };
 
+/// (internal) edge of the horizon of the triangles visible from a new convex hull vertex
+struct SphericalHorizonEdge
+{
+	int vertex[2];/// indices of the 2 vertices, in the winding order of the visible triangle
+	int outside;/// index of the non visible triangle beyond the edge
+};
+
 
 struct SphericalVertex
 {
@@ -58,6 +81,7 @@ struct SphericalVertex
 	int triangle;/// An incident triangle index (one among many)	
 	unsigned int flags = 0;/// (internal)	
 	int id = -1;		
+	int padding = 0;/// explicit padding, so that the files written by persistToDisk have no undefined bytes
 
 	void remove() { flags |= 1; }
 
@@ -71,6 +95,40 @@ struct SphericalVertex
 #define VERTEX_DELETED(v) (v.flags & 1 != 0)
 
 
+/// Statistics of the stages of the Poisson-Delaunay construction (see the poisson_radius constructor).
+struct SphericalDelaunayTimeData
+{
+	tool::StageStats sampling;/// Poisson sampling of the sphere
+	tool::StageStats naive_lawson;/// (SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION only) insertion order sort + naive triangulation of the first samples + Lawson flips
+	tool::StageStats insertion;/// insertion order sort + convex hull construction, or (SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION) incremental Delaunay insertion of the remaining samples
+};
+
+
+/**
+ * Header of the .sdt files written by SphericalDelaunay::persistToDisk.
+ * It is followed by the vertex and triangle arrays, as laid out in memory and aligned on SDT_FILE_SECTION_ALIGNMENT bytes, so that a mapped file is used in place.
+ */
+struct SphericalDelaunayFileHeader
+{
+	char magic[4];/// "SDT" + '\0'
+	uint32_t version;/// SDT_FILE_VERSION
+	uint32_t endianness;/// 0x01020304, as written by the host
+	uint32_t header_size;/// sizeof(SphericalDelaunayFileHeader)
+	uint32_t vertex_size;/// sizeof(SphericalVertex)
+	uint32_t triangle_size;/// sizeof(SphericalTriangle)
+	uint32_t num_vertices;
+	uint32_t num_triangles;
+	uint32_t vertex_range;/// number of stored vertices (deleted ones included)
+	uint32_t triangle_range;/// number of stored triangles (deleted ones included)
+	double sphere_radius;
+	double sphere_center[3];
+	uint64_t vertex_offset;/// byte offset of the vertex array
+	uint64_t triangle_offset;/// byte offset of the triangle array
+	uint64_t file_size;
+	uint64_t checksum;/// tool::checksum64 of the checksums of the vertex and triangle arrays
+};
+
+
 /**
  * @brief Spherical Delaunay Triangulation.
  * The triangulation uses an initial set of triangles to overcome problems with the sphere. In the implementation this initial set is comprised of the 8 triangles of a regular octahedron.
@@ -96,15 +154,18 @@ public:
 	/**
 	 * Constructor.
 	 * @brief constructs a spherical delaunay triangulation from poisson sampling of the sphere.
+	 * @param method (optional) Sampling method, both give about the same number of samples for a given poisson_radius.
+	 * @param radius_function (optional) Local poisson radius for a variable density sampling (poisson_radius is then the minimum radius). Poisson method only.
 	 */
-	SphericalDelaunay(double sphere_radius, double poisson_radius);
+	SphericalDelaunay(double sphere_radius, double poisson_radius, SphereSamplingMethod method = SphereSamplingMethod::POISSON, const PoissonSphereSampling::RadiusFunction & radius_function = PoissonSphereSampling::RadiusFunction());
 
 	/**
 	* Constructor.
+	* @brief constructs the triangulation as the convex hull of the vertices (see insertVertexConvexHull).
 	* @param vertices An initial list of vertices to build upon (note that the initial octahedron vertices will still be part of the triangulation).
 	* @param sphere_radius (optional) Radius of the sphere to triangulate.	
 	*/
-	//explicit SphericalDelaunay(const std::vector<math::dvec3> & vertices, double sphere_radius = 1.0);
+	explicit SphericalDelaunay(const std::vector<math::dvec3> & vertices, double sphere_radius = 1.0);
 
 	/**
 	 * Copy ctor.
@@ -118,11 +179,14 @@ public:
 
 
 
-	/** Load instance from disk */
-	bool loadFromDisk(std::string &filename);
+	/**
+	 * Load instance from disk : the file is mapped in memory and used in place (copy-on-write), until the triangulation needs more storage.
+	 * @returns False if the file can not be read, is not a .sdt file of the current version or host, or is corrupted.
+	 */
+	bool loadFromDisk(const std::string & filename);
 
 	/** Save instance data to disk. */
-	bool persistToDisk(std::string &filename);
+	bool persistToDisk(const std::string & filename) const;
 
 	/**
 	 * Releases resources.
@@ -149,6 +213,35 @@ public:
 
 	int naiveInsertVertex(const math::dvec3 & vertex);
 
+	/**
+	 * Inserts a vertex as a new vertex of the convex hull of the triangulation : the triangles visible from the vertex are replaced by a fan linking it to their horizon.
+	 * On the sphere a triangle is visible iff its circumcircle contains the vertex, so this preserves the Delaunay property without any edge flip.
+	 * @param [out] changed_triangles (optional) Appended with the indices of the new triangles (the slots of the replaced ones are reused).
+	 * @returns The index of the inserted vertex.
+	 */
+	int insertVertexConvexHull(const math::dvec3 & vertex, std::vector<int> * changed_triangles = nullptr);
+
+	/**
+	 * Removes a vertex and re-triangulates the hole, ie. the star of its incident triangles, with Delaunay ears : the Delaunay property is preserved.
+	 * The hole of a vertex of degree d is filled with d - 2 triangles reusing its slots, the 2 remaining slots and the vertex slot are freed for later insertions.
+	 * Triangles around the hole keep their index and vertices, only their neighbor links are updated.
+	 * @param [out] changed_triangles (optional) Appended with the indices of the d slots of the hole (new or deleted triangles).
+	 * @returns False if the vertex does not exist, if fewer than 4 vertices would remain or if the remaining vertices would no longer surround the sphere center (the triangulation is then unchanged).
+	 */
+	bool removeVertex(int vertex_index, std::vector<int> * changed_triangles = nullptr);
+
+	/**
+	 * Inserts a batch of vertices (sorted in insertion order beforehand, see sortInsertionOrder) with several threads, as insertVertexConvexHull does.
+	 * Each BRIO round is split into contiguous parts of the Hilbert curve, ie. regions of the sphere, inserted concurrently : a thread only modifies the triangles of its region,
+	 * the vertices whose cavity crosses a region boundary are deferred and inserted sequentially afterwards.
+	 * Vertex indices are those of a sequential insertion and the triangles are the same (the convex hull is unique), only their order in the array may differ (see sortTriangles).
+	 * @param num_threads (optional) Number of threads, 0 for the hardware concurrency.
+	 */
+	void insertVerticesParallel(const std::vector<math::dvec3> & vertices, unsigned int num_threads = 0);
+
+	/** Sorts the triangles by vertex indices and compacts the triangles array : the triangles order no longer depends on the construction order (nor on the number of threads). */
+	void sortTriangles();
+
 
 	/** Applies the Lawson algorithm (adapted to the sphere), ie. converts a naive triangulation into a Delaunay one, using edge flips. */
 	void applyLawson();
@@ -174,7 +267,7 @@ public:
 	/**
 	 * @returns A unique hashed value, from a non ordered pair of vertex indices.
 	 */
-	inline uint64_t hashEdge(unsigned int s0, unsigned int s1)
+	inline uint64_t hashEdge(unsigned int s0, unsigned int s1) const
 	{
 		uint64_t m = s0; uint64_t M = s1;
 		if (s1 < s0) {	m = s1;	M = s0;	}		
@@ -183,7 +276,7 @@ public:
 	/**
 	* @returns A unique hashed value from the specified edge.
 	*/
-	inline uint64_t hashEdge(const SphericalEdge & edge) { return hashEdge(edge.vertex[0], edge.vertex[1]); }	
+	inline uint64_t hashEdge(const SphericalEdge & edge) const { return hashEdge(edge.vertex[0], edge.vertex[1]); }	
 
 	double getSphereRadius() const { return m_sphere_radius; }
 
@@ -193,6 +286,16 @@ public:
 	/** Average edge length in km */
 	double getAverageTriangleEdgeLength() const;
 
+	/**
+	 * Builds the compressed (CSR) vertex to incident triangles table, in one pass.
+	 * The triangles incident to vertex v are triangles[offsets[v]] ... triangles[offsets[v + 1] - 1], in counterclockwise order seen from outside the sphere (none for a deleted vertex).
+	 * @param [out] offsets getVerticesRange() + 1 row offsets.
+	 * @param [out] triangles The concatenated rows.
+	 */
+	void getVertexTriangles(std::vector<int> & offsets, std::vector<int> & triangles) const;
+
+	inline const SphericalDelaunayTimeData & getTimeData() const { return m_time_data; }
+
 
 protected:
 
@@ -211,18 +314,55 @@ protected:
 	int findAvailableTriangleSlot();
 	/** @returns The next free index in the vertices array */
 	int findAvailableVertexSlot();
+	/** Copies the vertices and triangles of a mapped file to the heap and releases the mapping. */
+	void detachFromMappedFile();
+	/** Creates the convex hull of the base octahedron and of a list of vertices (sorted in insertion order beforehand). */
+	void createConvexHull(const std::vector<math::dvec3> & vertices);
+	/** Inserts the already stored vertex vertex_index as a new vertex of the convex hull (see insertVertexConvexHull). */
+	void insertStoredVertexConvexHull(int vertex_index);
+	/**
+	 * Collects the triangles visible from vertex (cavity), starting from the containing triangle, and the edges of their horizon with the triangles beyond it.
+	 * @param owners (optional) Owner of each triangle : fails (returns false) if the cavity or its horizon reaches a triangle not owned by owner.
+	 */
+	bool collectHullCavity(const math::dvec3 & vertex, int start_triangle, std::vector<int> & cavity, std::vector<SphericalHorizonEdge> & horizon, const int * owners = nullptr, int owner = -1) const;
+	/** Replaces the cavity by a fan of triangles linking vertex_index to the horizon edges, stored in slots (one per horizon edge). */
+	void replaceHullCavity(int vertex_index, const std::vector<int> & slots, const std::vector<SphericalHorizonEdge> & horizon, bool update_vertex_triangles);
+	/** Sets the triangle of each vertex to one of its incident triangles. */
+	void updateVertexTriangles();
+	/** Grows the vertices array to (at least) capacity. */
+	void reserveVertices(unsigned int capacity);
+	/** Grows the triangles array to (at least) capacity. */
+	void reserveTriangles(unsigned int capacity);
+	/** @returns True if p lies strictly above the plane of the triangle. */
+	inline bool isTriangleVisible(const SphericalTriangle & t, const math::dvec3 & p) const
+	{
+		return predicates::orient3d(m_vertices[t.vertex[0]].coordinates, m_vertices[t.vertex[1]].coordinates, m_vertices[t.vertex[2]].coordinates, p) > 0.0;
+	}
 	/** Creates a naive triangulation (ie. not of Delaunay) from a list of vertices, inserted into the base octahedron. */
 	void createNaiveTriangulation(const std::vector<math::dvec3> & vertices);
-	/** Finds the triangle that contains the specified point, using triangle marching by general direction heuristic (important: the point p is assumed to lie within the triangulation). */
-	int smartFindTriangleThatContains(math::dvec3 p) const;
+	/**
+	 * Finds the triangle that contains the specified point, using triangle marching by general direction heuristic (important: the point p is assumed to lie within the triangulation).
+	 * @param start_triangle (optional) Triangle the march starts from (a random one if -1 or deleted), ideally close to p.
+	 * @param owners (optional) Owner of each triangle : the march is restricted to the triangles owned by owner, and returns -1 if it has to leave them.
+	 */
+	int smartFindTriangleThatContains(math::dvec3 p, int start_triangle = -1, const int * owners = nullptr, int owner = -1) const;
+	/**
+	 * Reorders samples in a biased randomized insertion order (BRIO) : rounds of doubling size taken from a random permutation, each round sorted along a Hilbert curve.
+	 * Consecutive insertions are then close to each other and each point location march, starting from the previous insertion, stays short.
+	 */
+	void sortInsertionOrder(std::vector<math::dvec3> & samples, unsigned int seed) const;
 	
 
 protected:
 
-	/// Big array storing all triangles.
+	/// Big array storing all triangles (points into m_triangle_storage, or into the mapped file).
 	SphericalTriangle * m_triangles = nullptr;
-	/// Big array storing all vertices.
+	/// Big array storing all vertices (points into m_vertex_storage, or into the mapped file).
 	SphericalVertex * m_vertices = nullptr;	
+	/// Storage of the triangles, which grows in place (see tool::VirtualArray).
+	tool::VirtualArray<SphericalTriangle> m_triangle_storage;
+	/// Storage of the vertices, which grows in place.
+	tool::VirtualArray<SphericalVertex> m_vertex_storage;
 	/// a stack that tracks next available slot in vertices array
 	std::vector<int> m_vertices_freeslots;
 	/// a stack that tracks next available slot in triangles array
@@ -245,4 +385,13 @@ protected:
 	double m_sphere_radius = 1.0;
 	int m_vertex_id_count = 0;
 	int m_triangle_id_count = 0;//(unused)
+	/// triangle incident to the last inserted vertex, the next point location march starts from there
+	int m_last_insertion_triangle = -1;
+	/// (convex hull insertion) scratch lists of the visible triangles and of their horizon
+	std::vector<int> m_cavity;
+	std::vector<SphericalHorizonEdge> m_horizon;
+	/// file the vertex and triangle arrays point into, after loadFromDisk (nullptr if they are allocated on the heap)
+	tool::MappedFile * m_mapped_file = nullptr;
+	/// stage statistics, filled by the poisson_radius constructor
+	SphericalDelaunayTimeData m_time_data;
 };
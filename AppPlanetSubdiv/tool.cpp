@@ -1,5 +1,21 @@
 #include "tool.h"
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+
 
 
 
@@ -631,11 +647,208 @@ namespace tool {
 		return noise / maxAmp;
 	}
 
-}//end namespace tool
+	size_t getPeakResidentSetSize()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return (size_t)counters.PeakWorkingSetSize;
+		return 0;
+#else
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+#if defined(__APPLE__)
+		return (size_t)usage.ru_maxrss;// bytes
+#else
+		return (size_t)usage.ru_maxrss * 1024;// kilobytes
+#endif
+#endif
+	}
+
+	bool MappedFile::open(const std::string & filename)
+	{
+		close();
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			CloseHandle(file);
+			return false;
+		}
+		void * view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		if (view == nullptr)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+		m_file = file;
+		m_mapping = mapping;
+		m_data = (char*)view;
+		m_size = (size_t)size.QuadPart;
+#else
+		const int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void * view = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);// the mapping keeps its own reference to the file
+		if (view == MAP_FAILED)
+			return false;
+		m_data = (char*)view;
+		m_size = (size_t)st.st_size;
+#endif
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (m_data == nullptr)
+			return;
+#if defined(_WIN32)
+		UnmapViewOfFile(m_data);
+		CloseHandle((HANDLE)m_mapping);
+		CloseHandle((HANDLE)m_file);
+		m_file = nullptr;
+		m_mapping = nullptr;
+#else
+		munmap(m_data, m_size);
+#endif
+		m_data = nullptr;
+		m_size = 0;
+	}
+
+	uint64_t hilbertKey(const glm::dvec3 & p, const glm::dvec3 & center, double radius)
+	{
+		constexpr int ORDER = 16;
+		uint32_t X[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			const double u = std::min(std::max(0.5 + 0.5 * (p[k] - center[k]) / radius, 0.0), 1.0);
+			X[k] = std::min((uint32_t)(u * (1 << ORDER)), (1u << ORDER) - 1u);
+		}
+
+		// axes to transposed Hilbert index : inverse undo...
+		const uint32_t M = 1u << (ORDER - 1);
+		for (uint32_t Q = M; Q > 1; Q >>= 1)
+		{
+			const uint32_t P = Q - 1;
+			for (int i = 0; i < 3; ++i)
+			{
+				if (X[i] & Q)
+					X[0] ^= P;
+				else
+				{
+					const uint32_t t = (X[0] ^ X[i]) & P;
+					X[0] ^= t;
+					X[i] ^= t;
+				}
+			}
+		}
+		// ... then Gray encode
+		for (int i = 1; i < 3; ++i)
+			X[i] ^= X[i - 1];
+		uint32_t t = 0;
+		for (uint32_t Q = M; Q > 1; Q >>= 1)
+			if (X[2] & Q)
+				t ^= Q - 1;
+		for (int i = 0; i < 3; ++i)
+			X[i] ^= t;
+
+		// interleave the transposed bits
+		uint64_t key = 0;
+		for (int b = ORDER - 1; b >= 0; --b)
+			for (int i = 0; i < 3; ++i)
+				key = (key << 1) | ((X[i] >> b) & 1u);
+		return key;
+	}
+
+	void * reserveAddressSpace(size_t size)
+	{
+#if defined(_WIN32)
+		return VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+		void * address = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		return address == MAP_FAILED ? nullptr : address;
+#endif
+	}
+
+	bool commitAddressSpace(void * address, size_t size)
+	{
+		if (size == 0)
+			return true;
+#if defined(_WIN32)
+		return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;// already committed pages are left untouched
+#else
+		const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		return mprotect(address, (size + page - 1) / page * page, PROT_READ | PROT_WRITE) == 0;
+#endif
+	}
+
+	void releaseAddressSpace(void * address, size_t size)
+	{
+#if defined(_WIN32)
+		VirtualFree(address, 0, MEM_RELEASE);
+#else
+		munmap(address, size);
+#endif
+	}
 
+	uint64_t checksum64(const void * data, size_t size)
+	{
+		// 4 independent multiply-rotate lanes (so that they pipeline), merged at the end
+		const uint64_t PRIME0 = 0x9E3779B185EBCA87ULL, PRIME1 = 0xC2B2AE3D27D4EB4FULL;
+		uint64_t lane[4] = { PRIME0, PRIME1, ~PRIME0, ~PRIME1 };
+		const unsigned char * bytes = (const unsigned char *)data;
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			for (int k = 0; k < 4; ++k)
+			{
+				uint64_t word;
+				std::memcpy(&word, bytes + i + 8 * k, sizeof(word));
+				lane[k] += word * PRIME1;
+				lane[k] = (lane[k] << 31) | (lane[k] >> 33);
+				lane[k] *= PRIME0;
+			}
+		}
+		uint64_t h = (uint64_t)size * PRIME0;
+		for (int k = 0; k < 4; ++k)
+		{
+			h ^= lane[k];
+			h = ((h << 27) | (h >> 37)) * PRIME0 + PRIME1;
+		}
+		for (; i < size; ++i)
+		{
+			h ^= bytes[i] * PRIME0;
+			h = ((h << 23) | (h >> 41)) * PRIME1;
+		}
+		h ^= h >> 33;
+		h *= PRIME1;
+		h ^= h >> 29;
+		return h;
+	}
+
+}//end namespace tool
 
 
 
+#ifndef PLANET_HEADLESS
 namespace tool
 {
 
@@ -878,4 +1091,5 @@ namespace tool
 
 		static_init = false;
 	}
-}
\ No newline at end of file
+}
+#endif // PLANET_HEADLESS
\ No newline at end of file
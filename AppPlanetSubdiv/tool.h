@@ -1,6 +1,8 @@
 #pragma once
 
+#ifndef PLANET_HEADLESS
 #include "glversion.h"
+#endif
 
 #define GLM_FORCE_UNRESTRICTED_GENTYPE
 #define GLM_FORCE_CXX11
@@ -9,8 +11,12 @@
 #include "glm/gtc/matrix_transform.hpp" // glm::translate, glm::rotate, glm::scale, glm::perspective
 #include "glm/gtc/type_ptr.hpp" // value_ptr
 
+#include <cfloat>
+#include <vector>
+
 
 #define PI	3.1415926535897932384626433832795
+#define VIRTUAL_ARRAY_RESERVATION	(size_t(16) << 30)	// bytes of address space reserved by a tool::VirtualArray (it moves to a larger range beyond)
 
 
 namespace math = glm;
@@ -463,11 +469,19 @@ namespace tool
 
 
 
+#ifndef PLANET_HEADLESS
 #include <QtGui/qvector4d.h>
+#endif
 #include <cmath>
+#include <algorithm>
 #include <functional>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <random>
+#include <string>
+#include <type_traits>
 
 
 
@@ -675,10 +689,149 @@ namespace tool
 	static std::mt19937 cellprng = std::mt19937();
 
 
+	/**
+	* @returns The peak resident set size of the current process so far, in bytes (0 if unavailable on this platform).
+	*/
+	size_t getPeakResidentSetSize();
+
+	/// Statistics recorded for one stage of a CPU build pipeline: wall-clock time, number of processed items (for throughput) and peak resident memory at the end of the stage.
+	struct StageStats
+	{
+		double secs = 0.0;
+		long long items = 0;
+		size_t peak_rss_bytes = 0;
+	};
+
+	/** Fills in the statistics of a stage that started at 'start' and processed 'items' items. */
+	inline void recordStage(StageStats & stats, const std::chrono::high_resolution_clock::time_point & start, long long items)
+	{
+		stats.secs = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start).count();
+		stats.items = items;
+		stats.peak_rss_bytes = getPeakResidentSetSize();
+	}
+
+	/**
+	 * A whole file mapped in memory. Pages are copy-on-write : the mapped bytes may be modified in place, the changes never reach the file.
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile() {}
+		~MappedFile() { close(); }
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
+
+		/** Maps the file, returns false if it can not be opened or is empty. */
+		bool open(const std::string & filename);
+		void close();
+
+		inline char * data() const { return m_data; }
+		inline size_t size() const { return m_size; }
+
+	private:
+		char * m_data = nullptr;
+		size_t m_size = 0;
+#if defined(_WIN32)
+		void * m_file = nullptr;
+		void * m_mapping = nullptr;
+#endif
+	};
+
+	/** @returns A 64 bits checksum of a memory block (not cryptographic, processes 8 bytes at a time). */
+	uint64_t checksum64(const void * data, size_t size);
+
+	/**
+	 * @returns A random 32 bits value drawn from a (seed, counter) pair (SplitMix64 finalizer).
+	 * Counter-based : a parallel loop drawing from its item index gets the same numbers whatever the number of threads or the schedule.
+	 */
+	inline uint32_t counterRandom(uint64_t seed, uint64_t counter)
+	{
+		uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return (uint32_t)((z ^ (z >> 31)) >> 32);
+	}
+
+	/** @returns The index of p along a 3D Hilbert curve of order 16 covering the cube [center - radius, center + radius] (J. Skilling, Programming the Hilbert curve, 2004). */
+	uint64_t hilbertKey(const glm::dvec3 & p, const glm::dvec3 & center, double radius);
+
+	/** Reserves a range of the virtual address space (no memory is used until committed), returns nullptr on failure. */
+	void * reserveAddressSpace(size_t size);
+	/** Commits the first size bytes of a reserved range (zero-filled when first committed), returns false on failure. */
+	bool commitAddressSpace(void * address, size_t size);
+	/** Releases a whole reserved range. */
+	void releaseAddressSpace(void * address, size_t size);
+
+	/**
+	 * A contiguous array stored in a reserved range of the virtual address space, committed on demand : it grows in place, without copy, and only its touched pages are resident.
+	 * New elements are zero-filled (T must be trivially copyable).
+	 */
+	template <typename T>
+	class VirtualArray
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "VirtualArray elements are moved with memcpy");
+
+	public:
+		VirtualArray() {}
+		~VirtualArray() { release(); }
+
+		VirtualArray(const VirtualArray &) = delete;
+		VirtualArray & operator=(const VirtualArray &) = delete;
+
+		/** Grows the array to (at least) count elements, in place unless the reserved range is exceeded. Throws std::bad_alloc on failure. */
+		void grow(size_t count)
+		{
+			if (count <= m_capacity)
+				return;
+			if (count > m_reserved)
+			{   // first growth, or reserved range exceeded : move to a new range (falls back to a smaller one if the address space is limited)
+				size_t reserved = std::max(VIRTUAL_ARRAY_RESERVATION / sizeof(T), 2 * count);
+				void * data = reserveAddressSpace(reserved * sizeof(T));
+				if (data == nullptr)
+				{
+					reserved = 2 * count;
+					data = reserveAddressSpace(reserved * sizeof(T));
+				}
+				if (data == nullptr || !commitAddressSpace(data, count * sizeof(T)))
+					throw std::bad_alloc();
+				if (m_data != nullptr)
+				{
+					std::memcpy(data, m_data, m_capacity * sizeof(T));
+					releaseAddressSpace(m_data, m_reserved * sizeof(T));
+				}
+				m_data = (T*)data;
+				m_reserved = reserved;
+			}
+			else if (!commitAddressSpace(m_data, count * sizeof(T)))
+				throw std::bad_alloc();
+			m_capacity = count;
+		}
+
+		void release()
+		{
+			if (m_data != nullptr)
+				releaseAddressSpace(m_data, m_reserved * sizeof(T));
+			m_data = nullptr;
+			m_capacity = 0;
+			m_reserved = 0;
+		}
+
+		inline T * data() const { return m_data; }
+		inline size_t capacity() const { return m_capacity; }
+
+	private:
+		T * m_data = nullptr;
+		size_t m_capacity = 0;/// committed elements
+		size_t m_reserved = 0;/// reserved elements
+	};
+
+
 }//end namespace tool
 
 
 
+#ifndef PLANET_HEADLESS
 namespace tool
 {
 
@@ -736,4 +889,4 @@ namespace tool
 		static int num_sphere_triangles;
 	};
 }
-
+#endif // PLANET_HEADLESS
@@ -0,0 +1,203 @@
+#include "PlanetBaseBuilder.h"
+#include "PlanetData.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// planet_bake : headless command line front-end to PlanetBaseBuilder.
+// Builds the base mesh and the base river network of a planet without any display, OpenGL context or Qt runtime,
+// and reports wall-clock time, throughput and peak resident memory of each stage.
+// With --sweep, the build is repeated for several base mesh resolutions (Poisson radius = minimum edge length) so that
+// the asymptotic behaviour of each stage can be compared between revisions.
+
+
+static void printUsage()
+{
+	std::cout << "usage: planet_bake (--tectonic <file> | --maps <directory>) [--edge <km>] [--sweep [km,km,...]] [--adaptive <ratio>] [--lattice] [--sdt-cache <directory>] [--bake-cache <directory>] [--csv <file>]" << std::endl;
+	std::cout << "   --edge <km>        minimum edge length of the base mesh (default 40)" << std::endl;
+	std::cout << "   --adaptive <ratio> sample open ocean sparsely, up to ratio times the minimum edge length" << std::endl;
+	std::cout << "   --lattice          sample the base mesh with a jittered lattice instead of Poisson disks (fast preview)" << std::endl;
+	std::cout << "   --sdt-cache <dir>  load the base mesh triangulation from <dir> if cached there by a previous run, else save it there" << std::endl;
+	std::cout << "   --bake-cache <dir> load the whole base planet from <dir> if baked there by a previous run with the same inputs, else save it there" << std::endl;
+	std::cout << "   --sweep [list]     build once per minimum edge length (default 40,20,10,5), from coarse to fine" << std::endl;
+	std::cout << "   --csv <file>       append one line per stage and per build to <file>" << std::endl;
+}
+
+static bool parseLengths(const std::string & list, std::vector<double> & lengths)
+{
+	std::stringstream ss(list);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		const double km = std::atof(item.c_str());
+		if (km <= 0.0)
+			return false;
+		lengths.push_back(km);
+	}
+	return !lengths.empty();
+}
+
+struct NamedStage
+{
+	const char * name;
+	const char * items;
+	const tool::StageStats * stats;
+	bool reported;// false for the stages that can not run with these options (no zero rows)
+};
+
+static void report(const PlanetBaseBuilder & builder, const std::string & input, bool sdt_cache, bool bake_cache, std::ofstream & csv)
+{
+	const PlanetBaseTimeData & time = builder.getTimeData();
+	const NamedStage stages[] = {
+		{ "bake_cache_load", "vertices", &time.bake_cache_load, bake_cache },
+		{ "delaunay_cache_load", "vertices", &time.delaunay_cache_load, sdt_cache },
+		{ "poisson_sampling", "samples", &time.poisson_sampling, true },
+#ifdef SPHERICAL_DELAUNAY_LAWSON_CONSTRUCTION
+		{ "delaunay_naive_lawson", "samples", &time.delaunay_naive_lawson, true },
+#endif
+		{ "delaunay_insertion", "samples", &time.delaunay_insertion, true },
+		{ "edge_build", "edges", &time.edge_build, true },
+		{ "vertex_sampling", "vertices", &time.vertex_sampling, true },
+#ifdef BASE_MESH_HILBERT_ORDER
+		{ "mesh_reorder", "vertices", &time.mesh_reorder, true },
+#endif
+		{ "river_mouths", "mouths", &time.river_mouths, true },
+		{ "river_growth", "nodes", &time.river_growth, true },
+		{ "river_postprocess", "nodes", &time.river_postprocess, true },
+	};
+
+	std::printf("\nBENCH : minimum edge length %g km, maximum edge length %g km\n", builder.getMinimumEdgeLength(), builder.getMaximumEdgeLength());
+	std::printf("   %-22s %12s %10s %14s %14s\n", "stage", "items", "seconds", "items/s", "peak RSS (MB)");
+	for (const NamedStage & stage : stages)
+	{
+		if (!stage.reported)
+			continue;
+		const tool::StageStats & s = *stage.stats;
+		const double throughput = s.secs > 0.0 ? (double)s.items / s.secs : 0.0;
+		const double rss_mb = (double)s.peak_rss_bytes / (1024.0 * 1024.0);
+		std::printf("   %-22s %12lld %10.3f %14.0f %14.1f\n", stage.name, s.items, s.secs, throughput, rss_mb);
+		if (csv.is_open())
+			csv << input << "," << builder.getMinimumEdgeLength() << "," << builder.getMaximumEdgeLength() << "," << stage.name << "," << stage.items << "," << s.items << "," << s.secs << "," << throughput << "," << s.peak_rss_bytes << std::endl;
+	}
+	std::printf("   %-22s %12s %10.3f\n", "total", "", time.total_secs);
+	std::fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	std::string tectonic_file, maps_directory, csv_file, sdt_cache_directory, bake_cache_directory;
+	std::vector<double> lengths;
+	double adaptive_ratio = 1.0;
+	SphereSamplingMethod sampling_method = SphereSamplingMethod::POISSON;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg(argv[i]);
+		if (arg == "--tectonic" && i + 1 < argc)
+			tectonic_file = argv[++i];
+		else if (arg == "--maps" && i + 1 < argc)
+			maps_directory = argv[++i];
+		else if (arg == "--csv" && i + 1 < argc)
+			csv_file = argv[++i];
+		else if (arg == "--sdt-cache" && i + 1 < argc)
+			sdt_cache_directory = argv[++i];
+		else if (arg == "--bake-cache" && i + 1 < argc)
+			bake_cache_directory = argv[++i];
+		else if (arg == "--adaptive" && i + 1 < argc)
+		{
+			adaptive_ratio = std::atof(argv[++i]);
+			if (adaptive_ratio < 1.0)
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--lattice")
+			sampling_method = SphereSamplingMethod::LATTICE;
+		else if (arg == "--edge" && i + 1 < argc)
+		{
+			if (!parseLengths(argv[++i], lengths))
+			{
+				printUsage();
+				return 1;
+			}
+		}
+		else if (arg == "--sweep")
+		{
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+			{
+				if (!parseLengths(argv[++i], lengths))
+				{
+					printUsage();
+					return 1;
+				}
+			}
+			else
+				lengths.insert(lengths.end(), { 40.0, 20.0, 10.0, 5.0 });
+		}
+		else
+		{
+			printUsage();
+			return 1;
+		}
+	}
+	if (tectonic_file.empty() == maps_directory.empty())
+	{
+		printUsage();
+		return 1;
+	}
+	if (lengths.empty())
+		lengths.push_back(40.0);
+
+	PlanetData planet;
+	std::string input;
+	if (!tectonic_file.empty())
+	{
+		if (!planet.loadFromTectonicFile(tectonic_file))
+			return 1;
+		input = tectonic_file;
+	}
+	else
+	{
+		const char last = maps_directory.back();
+		if (last != '/' && last != '\\')
+			maps_directory += '/';
+		if (!planet.loadFromMaps(maps_directory))
+			return 1;
+		input = maps_directory;
+	}
+
+	std::ofstream csv;
+	if (!csv_file.empty())
+	{
+		csv.open(csv_file.c_str(), std::ofstream::out | std::ofstream::app);
+		if (!csv.good())
+		{
+			std::cout << "ERROR - planet_bake:: failed opening " << csv_file << std::endl;
+			return 1;
+		}
+		if (csv.tellp() == 0)
+			csv << "input,min_edge_km,max_edge_km,stage,item,items,seconds,items_per_second,peak_rss_bytes" << std::endl;
+	}
+
+	// note: peak RSS is a process-wide high-water mark, this is why sweeps should go from coarse to fine resolutions.
+	for (double km : lengths)
+	{
+		PlanetBaseBuilder builder(&planet, km);
+		builder.setAdaptiveDensity(adaptive_ratio * km);
+		builder.setSamplingMethod(sampling_method);
+		builder.setTriangulationCache(sdt_cache_directory);
+		builder.setBakeCache(bake_cache_directory);
+		builder.build();
+
+		std::cout << "BAKE: " << builder.getVertices().size() << " vertices, " << builder.getEdges().size() << " edges, " << builder.getTriangles().size() << " triangles, " << builder.getNumRiverNodes() << " river nodes." << std::endl;
+		report(builder, input, !sdt_cache_directory.empty(), !bake_cache_directory.empty(), csv);
+	}
+
+	return 0;
+}